@@ -4,25 +4,36 @@
 #include <stdio.h>
 
 #include "dac161s997.h"
-#include "mock_spi.h"
+#include "dac161s997_emu_port.h"
 
 int main (void)
 {
     uint32_t status = 0;
-    dac161s997_dev_t dev0 = {.cs_num = 0};
-    dac161s997_dev_t dev1 = {.cs_num = 1};
+    dac161s997_dev_t dev0;
+    dac161s997_dev_t dev1;
+
+    dac161s997_emu_port_init(&dev0, 1);
+    dac161s997_emu_port_init(&dev1, 2);
     puts("dac161s997_init(&dev0)");
     while (dac161s997_init(&dev0) != 0);
     puts("dac161s997_init(&dev1)");
     while (dac161s997_init(&dev1) != 0);
-    puts("dac161s997_set_output(&dev0, 1000)");
-    dac161s997_set_output(&dev0, 1000);
+    puts("dac161s997_set_output(&dev0, 12000000)");
+    dac161s997_set_output(&dev0, 12000000);
+    printf("loop current: %ld nA\n", (long)dac161s997_emu_output_na(&dev0.emu));
     puts("dac161s997_set_alarm(&dev0, DAC161S997_ALARM_LOW_FAIL)");
     dac161s997_set_alarm(&dev0, DAC161S997_ALARM_LOW_FAIL);
+    printf("loop current: %ld nA\n", (long)dac161s997_emu_output_na(&dev0.emu));
     puts("dac161s997_set_alarm(&dev0, DAC161S997_ALARM_HIGH_FAIL)");
     dac161s997_set_alarm(&dev0, DAC161S997_ALARM_HIGH_FAIL);
+    printf("loop current: %ld nA\n", (long)dac161s997_emu_output_na(&dev0.emu));
     puts("dac161s997_get_status(&dev0, &status)");
     dac161s997_get_status(&dev0, &status);
-    printf("status: 0x%X", status);
+    printf("status: 0x%X\n", status);
+
+    puts("opening the loop of dev1");
+    dev1.emu.faults |= DAC161S997_EMU_FAULT_LOOP_OPEN;
+    dac161s997_get_status(&dev1, &status);
+    printf("status: 0x%X\n", status);
     return 0;
-}
\ No newline at end of file
+}
@@ -1,8 +0,0 @@
-#ifndef SL_I420_APP_H_
-#define SL_I420_APP_H_
-
-struct dac161s997_dev_t {
-	uint32_t cs_num;
-};
-
-#endif /* SL_I420_APP_H_ */
\ No newline at end of file
@@ -27,6 +27,7 @@ extern "C" {
 
 /* Includes *******************************************************************/
 #include <stdint.h>
+#include <stddef.h>
 #include <errno.h>
 #include "dac161s997_types.h"
 
@@ -34,12 +35,105 @@ extern "C" {
 #define DAC161S997_MIN_NA   ((uint32_t)2000000)     /**< Min valid nA */
 #define DAC161S997_MAX_NA   ((uint32_t)24000000)    /**< Max valid nA */
 
+/**
+ * @defgroup DAC161S997_NE43
+ * @{
+ * Error levels as per NAMUR NE43. dac161s997_init() programs the fail levels
+ * as the alarm currents, dac161s997_set_alarm() also uses the saturation ones.
+ */
+#define DAC161S997_UNINIT_ALARM_NA  ((uint32_t)3300000)  /**< Uninitialized value in nA */
+#define DAC161S997_FAIL_LO_ALARM_NA ((uint32_t)3600000)  /**< Lo error value in nA */
+#define DAC161S997_SAT_LO_ALARM_NA  ((uint32_t)3800000)  /**< Lo saturation value in nA */
+#define DAC161S997_SAT_HI_ALARM_NA  ((uint32_t)20500000) /**< Hi saturation value in nA */
+#define DAC161S997_FAIL_HI_ALARM_NA ((uint32_t)21000000) /**< Hi error value in nA */
+/** @} */
+
+/** ERR_CONFIG bits of an SPI timeout of @p ms, 50 to 400 in steps of 50 */
+#define DAC161S997_ERR_CONFIG_SPI_TIMEOUT(ms)   ((uint16_t)(((ms) / 50 - 1) << 1))
+#define DAC161S997_INIT_SPI_TIMEOUT_MS  400     /**< SPI timeout set by dac161s997_init() */
+/** ERR_CONFIG written by dac161s997_init() */
+#define DAC161S997_INIT_ERR_CONFIG \
+    DAC161S997_ERR_CONFIG_SPI_TIMEOUT(DAC161S997_INIT_SPI_TIMEOUT_MS)
+
+/**
+ * @defgroup DAC161S997_CONV
+ * @{
+ * The DAC LSB is 24 mA / 65536 = 46875 / 128 nA. Codes are computed as a
+ * multiplication with a reciprocal and a shift, which rounds correctly over
+ * the whole 0 to 24 mA range without a division.
+ */
+#define DAC161S997_CODE_SHIFT   37  /**< Shift of the nA to DAC code reciprocal */
+/** Reciprocal of the LSB in nA, scaled by 2^DAC161S997_CODE_SHIFT */
+#define DAC161S997_CODE_MULT    ((uint32_t)(((1ULL << (DAC161S997_CODE_SHIFT + 7)) + 23437) / 46875))
+/** Rounded DAC code of @p n_amps >= 0 without saturation, 65536 from 23999817 nA up */
+#define DAC161S997_NA_TO_CODE_RAW(n_amps) \
+    ((uint32_t)(((uint64_t)(n_amps) * DAC161S997_CODE_MULT + \
+                 (1ULL << (DAC161S997_CODE_SHIFT - 1))) >> DAC161S997_CODE_SHIFT))
+/**
+ * Rounded DAC code of @p n_amps >= 0, saturated at 0xFFFF like
+ * dac161s997_na_to_code(). Meant for constants, @p n_amps is evaluated twice.
+ */
+#define DAC161S997_NA_TO_CODE(n_amps) \
+    ((DAC161S997_NA_TO_CODE_RAW(n_amps) > 0xFFFF) ? (uint32_t)0xFFFF : \
+                                                    DAC161S997_NA_TO_CODE_RAW(n_amps))
+/** @} */
+
 #define DAC161S997_ALARM_LOW_FAIL_ERR   0x0100 /**< Error flag for low device failure */
 #define DAC161S997_ALARM_LOW_SAT_ERR    0x0200 /**< Error flag for value set to lower bound saturation */
 #define DAC161S997_ALARM_UNINIT_ERR     0x0400 /**< Error flag for device uninitialized */
 #define DAC161S997_ALARM_HI_SAT_ERR     0x0800 /**< Error flag for value set to upper bound saturation */
 #define DAC161S997_ALARM_HI_FAIL_ERR    0x1000 /**< Error flag for high device failure */
 
+/**
+ * @defgroup DAC161S997_REGS
+ * @{
+ */
+#define DAC161S997_XFR_REG                  0x01    /**< Command: transfer data into register (protected write mode) */
+#define DAC161S997_NOP_REG                  0x02    /**< Command: does nothing except resetting the timeout timer */
+#define DAC161S997_PROTECT_REG_WR_REG       0x03    /**< 1 means protected write mode in effect */
+#define DAC161S997_DACCODE_REG              0x04    /**< 16 bit DAC code to be written */
+#define DAC161S997_ERR_CONFIG_REG           0x05    /**< Configuration of error states */
+#define DAC161S997_ERR_LOW_REG              0x06    /**< DAC code for the <4mA alarm level */
+#define DAC161S997_ERR_HIGH_REG             0x07    /**< DAC code for the >20mA alarm level */
+#define DAC161S997_RESET_REG                0x08    /**< Command: reset the chip */
+#define DAC161S997_STATUS_REG               0x09    /**< Status of the chip */
+/** @} */
+
+/** Number of uint32_t words of an error map covering @p n channels */
+#define DAC161S997_ERR_MAP_WORDS(n)         (((n) + 31) / 32)
+
+#define DAC161S997_SPI_TIMEOUT_NS           400000000ULL    /**< SPI timeout set by dac161s997_init() */
+#define DAC161S997_KEEPALIVE_NS             (DAC161S997_SPI_TIMEOUT_NS / 2) /**< Idle time after which a device gets a keepalive */
+
+#define DAC161S997_CAL_MAX_POINTS           8       /**< Max points of a calibration table */
+#define DAC161S997_CAL_BUCKET_SHIFT         10      /**< Code bits dropped to find a calibration segment */
+
+#define DAC161S997_ASYNC_MAX_OPS            6       /**< Ops of the largest asynchronous request */
+
+#define DAC161S997_REG_READ                 0x80    /**< Address flag for read commands */
+
+#ifndef DAC161S997_STATS
+/** Set to 1 to keep the counters of dac161s997_stats_get(), changes the size of the context */
+#define DAC161S997_STATS                    0
+#endif
+
+/**
+ * @defgroup DAC161S997_STATS_OP
+ * @{
+ */
+#define DAC161S997_STATS_OP_INIT            0   /**< Latency of dac161s997_init() */
+#define DAC161S997_STATS_OP_SET_OUTPUT      1   /**< Latency of dac161s997_set_output() */
+#define DAC161S997_STATS_OP_SET_ALARM       2   /**< Latency of dac161s997_set_alarm() */
+#define DAC161S997_STATS_OP_GET_STATUS      3   /**< Latency of dac161s997_get_status() */
+#define DAC161S997_STATS_OPS                4   /**< Number of operations timed */
+/** @} */
+#define DAC161S997_STATS_BUCKETS            32  /**< Buckets of a latency histogram */
+
+/** Initializer of a dac161s997_op_t reading register @p reg */
+#define DAC161S997_OP_READ(reg)             { (uint8_t)((reg) | DAC161S997_REG_READ), 0, 0 }
+/** Initializer of a dac161s997_op_t writing @p val to register @p reg */
+#define DAC161S997_OP_WRITE(reg, val)       { (uint8_t)(reg), (uint16_t)(val), 0 }
+
 /**
  * @defgroup I420_STATUS_MASK
  * @{
@@ -50,6 +144,8 @@ extern "C" {
 #define DAC161S997_STATUS_FRAME_ERR     0x08    /**< SPI frame error */
 #define DAC161S997_LO_ALARM_ERR         0x10    /**< Output at low error value */
 #define DAC161S997_HI_ALARM_ERR         0x20    /**< Output at high error value */
+#define DAC161S997_STATUS_MISMATCH      0x40    /**< A register differs from what the driver wrote, see dac161s997_audit() */
+#define DAC161S997_STATUS_RECOVERED     0x80    /**< The registers were restored, see dac161s997_recover() */
 /** @} */
 
 /* Typedefs *******************************************************************/
@@ -61,7 +157,150 @@ typedef enum {
     DAC161S997_ALARM_HIGH_FAIL  = DAC161S997_ALARM_HI_FAIL_ERR,     /**< Alarm for high device failure */
 } DAC161S997_ALARM_t;       /**< DAC161S997 alarm types */
 
+typedef enum {
+    DAC161S997_VERIFY_ALWAYS = 0,   /**< Every call ends with a NOP clocking out the last echo */
+    DAC161S997_VERIFY_LAZY,         /**< The last echo is checked by the next frame to the device */
+    DAC161S997_VERIFY_EVERY_N,      /**< Every Nth call ending with a write is verified, others are not */
+    DAC161S997_VERIFY_CONFIG_ONLY,  /**< Calls ending with a DACCODE write are not verified */
+} DAC161S997_VERIFY_t;      /**< Verification of the last write of a call */
+
+typedef enum {
+    DAC161S997_CONV_AUTO = 0,       /**< Fastest kernel the build and CPU support */
+    DAC161S997_CONV_SCALAR,         /**< Portable C */
+    DAC161S997_CONV_SSE2,           /**< x86 SSE2 */
+    DAC161S997_CONV_AVX2,           /**< x86 AVX2, checked on the CPU at run time */
+    DAC161S997_CONV_NEON,           /**< AArch64 NEON */
+} DAC161S997_CONV_t;        /**< Kernel of the bulk nA to DAC code conversion */
+
+typedef struct {
+    uint8_t addr;       /**< Register address, ORed with DAC161S997_REG_READ for reads */
+    uint16_t data;      /**< Data to write, or data that has been read */
+    int err;            /**< Result of this op, set by dac161s997_xfer_batch() */
+} dac161s997_op_t;          /**< A single register op of a batch */
+
+typedef struct {
+    int32_t set_na;         /**< Current requested from the uncalibrated device */
+    int32_t measured_na;    /**< Current measured by the reference meter */
+} dac161s997_cal_point_t;   /**< A point of a calibration table */
+
+/**
+ * @brief	Precomputed piecewise-linear output correction.
+ *
+ * Filled by dac161s997_cal_load(), the members are private to the driver.
+ */
+typedef struct {
+    uint16_t in_code[DAC161S997_CAL_MAX_POINTS];    /**< Ideal code at the start of each segment */
+    int32_t out_code[DAC161S997_CAL_MAX_POINTS];    /**< Corrected code at the start of each segment */
+    int32_t slope[DAC161S997_CAL_MAX_POINTS];       /**< Corrected codes per ideal code, Q16 */
+    uint8_t bucket[(0xFFFF >> DAC161S997_CAL_BUCKET_SHIFT) + 1];    /**< First segment of each code bucket */
+    uint8_t n;              /**< Number of segments */
+} dac161s997_cal_t;
+
+/**
+ * @brief	Completion callback of an asynchronous request.
+ *
+ * Runs in the context that called dac161s997_xfer_done(), which may be an
+ * interrupt.
+ *
+ * @param[in]	dev			Device the request was started on
+ * @param[in]	err			Result the blocking call would have returned
+ * @param[in]	arg			User argument given to the start call
+ */
+typedef void (*dac161s997_cb_t)(dac161s997_dev_t *dev, int err, void *arg);
+
+/**
+ * @brief	Instrumentation counters of a device.
+ *
+ * Bucket b of a latency histogram counts the calls that took from 2^(b-1) up
+ * to 2^b - 1 ns, bucket 0 the ones that took 0 ns and the last one
+ * everything longer. Counters wrap around, monitors should work on the
+ * difference of two snapshots.
+ */
+typedef struct {
+    uint32_t seq;           /**< Even when consistent, private to the driver */
+    uint32_t frames;        /**< Frames sent */
+    uint32_t echo_errors;   /**< Ops whose echo did not match, -ENOEXEC */
+    uint32_t port_errors;   /**< Frames the port failed to send */
+    uint32_t retries;       /**< Ops sent again after a failure */
+    uint32_t skipped_writes;    /**< DACCODE writes skipped as already set */
+    uint32_t latency[DAC161S997_STATS_OPS][DAC161S997_STATS_BUCKETS];   /**< Histogram of each @ref DAC161S997_STATS_OP */
+} dac161s997_stats_t;
+
+/**
+ * @brief	Driver owned state of a single chip.
+ *
+ * Must be zero initialized and provided through dac161s997_get_ctx(). The
+ * members are private to the driver.
+ */
+struct dac161s997_ctx {
+    uint16_t shadow[5];     /**< Last known value of registers 0x03 to 0x07 */
+    uint8_t shadow_valid;   /**< Bitmask of the shadow registers that are known */
+    uint16_t intent[5];     /**< Last value written to registers 0x03 to 0x07 */
+    uint8_t intent_valid;   /**< Bitmask of the registers written since the last reset */
+    const dac161s997_cal_t *cal;    /**< Output correction, NULL if none */
+    uint64_t last_frame_ns; /**< End of the last transfer if its echoes were correct, else 0 */
+    uint8_t last_tx[3];     /**< Last frame sent, the next echo must match it if last_tx[0] */
+    uint8_t read_in_flight; /**< Read whose data the next frame clocks out, 0 if none */
+    uint16_t trace_id;      /**< Id of the device in its trace */
+    struct dac161s997_trace *trace; /**< Recorder of the frames, NULL if none */
+    struct {
+        uint16_t every;     /**< Fast status calls per audit, 0 for none */
+        uint16_t count;     /**< Fast status calls since the last audit */
+        uint8_t suspect;    /**< The last status calls the next one to audit */
+        uint8_t heal;       /**< Status calls recover from the faults they see */
+    } audit;                /**< Cadence of dac161s997_get_status_fast() */
+    struct {
+        uint8_t policy;     /**< A DAC161S997_VERIFY_t */
+        uint8_t retries;    /**< Times a mismatching call is resent */
+        uint16_t every_n;   /**< Period of DAC161S997_VERIFY_EVERY_N */
+        uint16_t count;     /**< Unverified calls since the last verified one */
+        uint8_t pending[3]; /**< Frame whose echo the next frame checks, if pending[0] */
+        int err;            /**< Lazy mismatch not reported yet */
+    } verify;               /**< Write verification, see dac161s997_set_verify() */
+#if DAC161S997_STATS
+    dac161s997_stats_t stats;   /**< Instrumentation of the device */
+#endif
+    struct {
+        dac161s997_op_t ops[DAC161S997_ASYNC_MAX_OPS];  /**< Ops of the request */
+        uint8_t tx_buf[3];  /**< Frame being sent */
+        uint8_t rx_buf[3];  /**< Frame being received */
+        uint8_t n;          /**< Number of ops */
+        uint8_t frames;     /**< Number of frames, n or n + 1 with the NOP */
+        uint8_t frame;      /**< Index of the frame in flight */
+        int err;            /**< First error of the ops */
+        volatile int result;    /**< -EINPROGRESS while a request is running */
+        void (*finish)(dac161s997_dev_t *dev, int err); /**< Request completion */
+        dac161s997_cb_t cb; /**< User completion */
+        void *arg;          /**< User argument */
+        uint32_t *status;   /**< Output of a status request */
+    } async;                /**< Asynchronous request in flight */
+};
+
+typedef struct {
+    dac161s997_dev_t *const *devs;  /**< Devices to keep alive */
+    size_t n;               /**< Number of devices */
+    uint64_t period_ns;     /**< Max time a device may go without a frame */
+    uint64_t window_ns;     /**< How early before the period a keepalive may be sent */
+    size_t max_per_poll;    /**< Keepalives per poll unless a device is overdue */
+    size_t next;            /**< Device the next poll starts with */
+} dac161s997_keepalive_t;   /**< Keepalive scheduler of a set of devices */
+
 /* Function prototypes ********************************************************/
+/**
+ * @brief	Checks a current against the valid output range.
+ *
+ * Negative currents wrap to above DAC161S997_MAX_NA and are rejected too.
+ *
+ * @param[in]	n_amps		Current in nA
+ *
+ * @return		1 if DAC161S997_MIN_NA <= @p n_amps <= DAC161S997_MAX_NA, else 0
+ */
+static inline int dac161s997_na_valid(int32_t n_amps)
+{
+    return (uint32_t)n_amps >= DAC161S997_MIN_NA &&
+           (uint32_t)n_amps <= DAC161S997_MAX_NA;
+}
+
 /**
  * @brief   Initialize the dac161s997 chip.
  *
@@ -80,6 +319,46 @@ typedef enum {
  */
 int dac161s997_init(dac161s997_dev_t *dev);
 
+/**
+ * @brief   Initialize the dac161s997 chip without disturbing a running loop.
+ *
+ * Reads back the configuration in one batch instead of resetting the chip,
+ * as after a restart of the controller. If it matches what
+ * dac161s997_init() writes the current DACCODE is kept, so the loop carries
+ * on without a glitch. Otherwise only the registers that differ are
+ * rewritten and the output goes to the low alarm level as with
+ * dac161s997_init(). If the read back is inconsistent the chip gets a full
+ * dac161s997_init().
+ *
+ * @param[in]	dev		device to initialize
+ *
+ * @return		0               No errors occurred
+ * @return      -ENXIO			Device is not present
+ * @return      -ENOEXEC		The device did get expected values
+ * @return		errors from dac161s997_spi_xfer()
+ */
+int dac161s997_init_warm(dac161s997_dev_t *dev);
+
+/**
+ * @brief   Restores the registers of a device after a communication fault.
+ *
+ * The context keeps the last value the driver wrote to each register, even
+ * if the write failed. The registers are read back in one batch and only
+ * those that differ are rewritten, so the last setpoint is restored and an
+ * output that is still right is not touched. Only if the read back fails or
+ * is inconsistent does the chip get a full dac161s997_init(), after which
+ * the configuration and setpoint are restored too. Without a context there
+ * is nothing to restore from and the chip gets a dac161s997_init().
+ *
+ * @param[in]	dev		device to recover
+ *
+ * @return		0               Registers restored
+ * @return      -ENXIO			Device is not present
+ * @return      -ENOEXEC		The device did get expected values
+ * @return		errors from dac161s997_spi_xfer()
+ */
+int dac161s997_recover(dac161s997_dev_t *dev);
+
 /**
  * @brief	Sets current in nA to output.
  *
@@ -89,6 +368,12 @@ int dac161s997_init(dac161s997_dev_t *dev);
  * device is no longer communicating, an error will return output will not
  * change.
  *
+ * If the device has a context and the current is already set, only a NOP is
+ * sent to keep the SPI timeout from expiring. With dac161s997_timestamp_ns()
+ * even that is skipped unless the device has gone DAC161S997_KEEPALIVE_NS
+ * without a correct echo, and the NOP fails with -ENOEXEC if the device does
+ * not echo it.
+ *
  * @pre		Device must be initialized with dac161s997_init
  *
  * @param[in]	dev			Device to select
@@ -101,6 +386,86 @@ int dac161s997_init(dac161s997_dev_t *dev);
  */
 int dac161s997_set_output(dac161s997_dev_t *dev, int32_t n_amps);
 
+/**
+ * @brief	Sets the DAC code to output.
+ *
+ * Same as dac161s997_set_output() for a code computed beforehand, with
+ * dac161s997_na_to_code() or DAC161S997_NA_TO_CODE() for constants. The
+ * calibration of the device is applied, the range is not checked.
+ *
+ * @pre		Device must be initialized with dac161s997_init
+ *
+ * @param[in]	dev			Device to select
+ * @param[in]	code		Uncalibrated DAC code
+ *
+ * @return		0			Status update successful
+ * @return      -ENOEXEC	The device did get expected values
+ * @return		errors from dac161s997_spi_xfer()
+ */
+int dac161s997_set_code(dac161s997_dev_t *dev, uint16_t code);
+
+/**
+ * @brief	Sets the output current of many devices in one call.
+ *
+ * All setpoints are validated and converted before any traffic starts, then
+ * every 32 devices get their DACCODE frames in one pass and the NOPs that
+ * verify them in a second, each pass in one dac161s997_spi_xfer_each() call
+ * if the port has it. A failing channel does not stop the others, it is
+ * flagged in @p err_map instead: bit (i % 32) of word (i / 32) is set if
+ * channel i failed.
+ *
+ * Devices with a context that are already at their setpoint only get a NOP
+ * keepalive, as with dac161s997_set_output().
+ *
+ * @pre		Devices must be initialized with dac161s997_init
+ *
+ * @param[in]	devs		Devices to select
+ * @param[in]	n_amps		Current to set in nA, one per device
+ * @param[in]	n			Number of devices
+ * @param[out]	err_map		Channels that failed, DAC161S997_ERR_MAP_WORDS(n) words
+ *
+ * @return		0			All outputs updated
+ * @return      -ENOEXEC	The device did get expected values
+ * @return		-EINVAL		Value out of range
+ * @return		errors from dac161s997_spi_xfer()
+ * @return		The error of the first failed channel if more than one failed
+ */
+int dac161s997_set_outputs(dac161s997_dev_t *const *devs,
+                           const int32_t *n_amps, size_t n,
+                           uint32_t *err_map);
+
+/**
+ * @brief	Sets the output current of many devices at the same instant.
+ *
+ * Same as dac161s997_set_outputs() except that the outputs change together.
+ * Every device is first put in protected write mode and sent its DACCODE,
+ * which the chip holds. Then the XFR commands that make the held codes
+ * effective go out back to back, or as one frame per 32 channels with
+ * dac161s997_spi_xfer_multi(), and the devices go back to direct writes.
+ * The outputs of the group change within a few frame times of each other
+ * instead of one full update apart, for example for split-range valves.
+ *
+ * Devices already at their setpoint are not part of the commit. A channel
+ * whose commit failed may or may not have changed, its DACCODE is no longer
+ * taken as known.
+ *
+ * @pre		Devices must be initialized with dac161s997_init
+ *
+ * @param[in]	devs		Devices to select
+ * @param[in]	n_amps		Current to set in nA, one per device
+ * @param[in]	n			Number of devices
+ * @param[out]	err_map		Channels that failed, DAC161S997_ERR_MAP_WORDS(n) words
+ *
+ * @return		0			All outputs updated
+ * @return      -ENOEXEC	The device did get expected values
+ * @return		-EINVAL		Value out of range
+ * @return		errors from dac161s997_spi_xfer()
+ * @return		The error of the first failed channel if more than one failed
+ */
+int dac161s997_set_outputs_sync(dac161s997_dev_t *const *devs,
+                                const int32_t *n_amps, size_t n,
+                                uint32_t *err_map);
+
 /**
  * @brief	Sets alarm values to output.
  *
@@ -126,16 +491,417 @@ int dac161s997_set_alarm(dac161s997_dev_t *dev, DAC161S997_ALARM_t alarm);
  * This checks the status of the device to find out the device is still working
  * or the output line is still connected.
  *
+ * If the device has a context the alarm levels are taken from it instead of
+ * being read back.
+ *
  * @pre		Device must be initialized with dac161s997_init
  *
  * @param[in]	dev			Device to select
  * @param[out]	status		Status bits of @ref I420_STATUS_MASK
  *
  * @return		0			Status update successful
+ * @return		-ENOEXEC	An earlier write checked lazily did not match,
+ *                          see dac161s997_set_verify(), @p status is valid
  * @return		errors from dac161s997_spi_xfer()
  */
 int dac161s997_get_status(dac161s997_dev_t *dev, uint32_t *status);
 
+/**
+ * @brief	Returns the status of a device reading only STATUS.
+ *
+ * The alarm flags are derived from the last known DACCODE and alarm levels.
+ * The read is pipelined: the frame that asks for STATUS also clocks out the
+ * STATUS asked for by the previous call, so when polled back to back each
+ * call costs a single frame and reports the STATUS sampled by the previous
+ * call. Any other frame to the device in between costs one more frame.
+ *
+ * Every dac161s997_set_audit() calls, and whenever the last status showed an
+ * error or the driver lost track of a register, the call runs
+ * dac161s997_audit() instead. Without a context this is dac161s997_get_status().
+ *
+ * @pre		Device must be initialized with dac161s997_init
+ *
+ * @param[in]	dev			Device to select
+ * @param[out]	status		Status bits of @ref I420_STATUS_MASK
+ *
+ * @return		0			Status update successful
+ * @return		errors from dac161s997_spi_xfer()
+ */
+int dac161s997_get_status_fast(dac161s997_dev_t *dev, uint32_t *status);
+
+/**
+ * @brief	Returns the status of a device after reading back all registers.
+ *
+ * Reads STATUS and every configuration register in one batch and compares
+ * them with what the driver wrote. A register that changed behind the
+ * driver's back sets DAC161S997_STATUS_MISMATCH and the driver adopts the
+ * value read, so the next dac161s997_set_output() rewrites a corrupted
+ * DACCODE. dac161s997_recover() restores the configuration.
+ *
+ * @pre		Device must be initialized with dac161s997_init
+ *
+ * @param[in]	dev			Device to select
+ * @param[out]	status		Status bits of @ref I420_STATUS_MASK
+ *
+ * @return		0			Status update successful
+ * @return		errors from dac161s997_spi_xfer()
+ */
+int dac161s997_audit(dac161s997_dev_t *dev, uint32_t *status);
+
+/**
+ * @brief	Sets how often dac161s997_get_status_fast() runs a full audit.
+ *
+ * @param[in]	dev			Device to configure
+ * @param[in]	every		Fast calls per audit, 0 to only audit on suspicion
+ *
+ * @return		0			Cadence set
+ * @return		-ENOTSUP	The device has no context
+ */
+int dac161s997_set_audit(dac161s997_dev_t *dev, uint16_t every);
+
+/**
+ * @brief	Lets the status calls recover from the faults they see.
+ *
+ * When enabled, a bad echo, DAC161S997_STATUS_COM_TIMEOUT,
+ * DAC161S997_STATUS_FRAME_ERR or DAC161S997_STATUS_MISMATCH seen by
+ * dac161s997_get_status(), dac161s997_get_status_fast() or
+ * dac161s997_audit() runs dac161s997_recover(). On success the call returns
+ * 0 with DAC161S997_STATUS_RECOVERED added to the status it saw.
+ *
+ * @param[in]	dev			Device to configure
+ * @param[in]	enable		Non zero to recover, 0 to leave it to the caller
+ *
+ * @return		0			Setting changed
+ * @return		-ENOTSUP	The device has no context
+ */
+int dac161s997_set_self_heal(dac161s997_dev_t *dev, int enable);
+
+/**
+ * @brief	Converts a current in nA to the closest DAC code.
+ *
+ * @param[in]	n_amps		Current in nA, clamped to the 0 to 24 mA range
+ *
+ * @return		DAC code
+ */
+uint16_t dac161s997_na_to_code(int32_t n_amps);
+
+/**
+ * @brief	Converts a DAC code to the current it outputs.
+ *
+ * @param[in]	code		DAC code, for example read back from the device
+ *
+ * @return		Current in nA, rounded
+ */
+int32_t dac161s997_code_to_na(uint16_t code);
+
+/**
+ * @brief	Converts and range checks an array of currents.
+ *
+ * codes[i] is dac161s997_na_to_code() of n_amps[i], bit for bit. Bit (i % 32)
+ * of word (i / 32) of @p err_map is set if n_amps[i] is outside of
+ * DAC161S997_MIN_NA to DAC161S997_MAX_NA, as dac161s997_set_output() would
+ * reject it. Runs on the kernel picked by dac161s997_conv_select().
+ *
+ * @param[in]	n_amps		Currents in nA
+ * @param[out]	codes		DAC codes, @p n of them
+ * @param[in]	n			Number of currents
+ * @param[out]	err_map		Currents out of range, DAC161S997_ERR_MAP_WORDS(n) words
+ *
+ * @return		Number of currents out of range
+ */
+size_t dac161s997_na_to_codes(const int32_t *n_amps, uint16_t *codes,
+                              size_t n, uint32_t *err_map);
+
+/**
+ * @brief	Converts an array of currents to DACCODE write frames.
+ *
+ * Same as dac161s997_na_to_codes() but writes 3 byte DACCODE frames ready for
+ * the bus, as used by the waveform player. No calibration is applied.
+ *
+ * @param[in]	n_amps		Currents in nA
+ * @param[out]	frames		3 * @p n bytes of frames
+ * @param[in]	n			Number of currents
+ * @param[out]	err_map		Currents out of range, DAC161S997_ERR_MAP_WORDS(n) words
+ *
+ * @return		Number of currents out of range
+ */
+size_t dac161s997_na_to_frames(const int32_t *n_amps, uint8_t *frames,
+                               size_t n, uint32_t *err_map);
+
+/**
+ * @brief	Selects the kernel of the bulk conversions.
+ *
+ * DAC161S997_CONV_AUTO is used until something else is selected. All kernels
+ * give the same results. Building with DAC161S997_CONV_SIMD set to 0 leaves
+ * only the portable one.
+ *
+ * @param[in]	conv		Kernel to use
+ *
+ * @return		0			Kernel selected
+ * @return		-ENOTSUP	Not built in or not supported by the CPU
+ */
+int dac161s997_conv_select(DAC161S997_CONV_t conv);
+
+/**
+ * @brief	Sets up a keepalive scheduler.
+ *
+ * The period defaults to DAC161S997_KEEPALIVE_NS and keepalives may go out
+ * up to half a period early, which lets them spread over many polls instead
+ * of bursting when all devices were last written at the same time.
+ *
+ * @param[out]	ka			Scheduler to set up, the fields may be tuned afterwards
+ * @param[in]	devs		Devices to keep alive, must stay valid
+ * @param[in]	n			Number of devices
+ * @param[in]	max_per_poll	Keepalives sent per poll to devices that are
+ *                          not overdue yet, 0 for no limit
+ */
+void dac161s997_keepalive_init(dac161s997_keepalive_t *ka,
+                               dac161s997_dev_t *const *devs, size_t n,
+                               size_t max_per_poll);
+
+/**
+ * @brief	Sends NOPs to the devices about to hit their SPI timeout.
+ *
+ * Every frame the driver sends to a device counts as a keepalive once its
+ * echo checks out, so only idle devices get a NOP and the bus load scales
+ * with the number of idle devices. After a frame without a correct echo a
+ * device gets a NOP every poll, which fails with -ENOEXEC only if the NOP
+ * itself is not echoed, an absent device for example. Devices idle for more
+ * than the period minus the window are eligible, up to
+ * dac161s997_keepalive_t::max_per_poll of them get a NOP per poll, starting
+ * where the last poll stopped. Devices past the period always get one.
+ * Devices without a context cannot be tracked and get one every poll.
+ *
+ * Should be polled at least a few times per window.
+ *
+ * @param[in,out]	ka		Scheduler to poll
+ *
+ * @return		0			No errors occurred
+ * @return		-ENOTSUP	The port has no dac161s997_timestamp_ns()
+ * @return		-ENOEXEC	A device did not echo its keepalive
+ * @return		errors from dac161s997_spi_xfer() of the first failed device
+ */
+int dac161s997_keepalive_poll(dac161s997_keepalive_t *ka);
+
+/**
+ * @brief	Precomputes a calibration table.
+ *
+ * Each point tells which current came out of the device when asking for
+ * another one. Between points the correction is linear, outside of them the
+ * first or last segment is extended. A single point is a pure offset, two
+ * points are a gain and offset correction.
+ *
+ * All divisions happen here, applying the correction with
+ * dac161s997_cal_apply() takes a table lookup and a multiply-add. Slopes are
+ * kept in Q16, so the set_na span of a segment must stay below 32768 times
+ * its measured_na span.
+ *
+ * @param[out]	cal			Table to fill
+ * @param[in]	points		Points sorted by strictly increasing measured_na
+ * @param[in]	n			Number of points, 1 to DAC161S997_CAL_MAX_POINTS
+ *
+ * @return		0			Table loaded
+ * @return		-EINVAL		Not enough, too many or unsorted points, or a
+ *                          segment too steep, @p cal is left untouched
+ */
+int dac161s997_cal_load(dac161s997_cal_t *cal,
+                        const dac161s997_cal_point_t *points, size_t n);
+
+/**
+ * @brief	Corrects a DAC code with a calibration table.
+ *
+ * @param[in]	cal			Table from dac161s997_cal_load()
+ * @param[in]	code		Ideal code of the wanted current
+ *
+ * @return		Code to send to get the wanted current, clamped to 16 bit
+ */
+uint16_t dac161s997_cal_apply(const dac161s997_cal_t *cal, uint16_t code);
+
+/**
+ * @brief	Applies a calibration table to a device.
+ *
+ * The correction is used for every output and alarm level set afterwards,
+ * including the ones written by dac161s997_init(). The table must stay valid
+ * while in use and may be shared between devices.
+ *
+ * @param[in]	dev			Device to calibrate
+ * @param[in]	cal			Table from dac161s997_cal_load(), NULL to remove
+ *
+ * @return		0			Calibration applied
+ * @return		-ENOTSUP	The device has no context
+ */
+int dac161s997_set_cal(dac161s997_dev_t *dev, const dac161s997_cal_t *cal);
+
+/**
+ * @brief	Selects how the writes to a device are verified.
+ *
+ * The echo of a frame only comes back with the next one, so verifying the
+ * last write of a call costs a trailing NOP frame. Ops in the middle of a
+ * call are always verified for free by the pipeline, and so are reads.
+ *
+ * With DAC161S997_VERIFY_LAZY the next frame sent to the device, whatever
+ * call it belongs to, checks the echo instead. A mismatch invalidates the
+ * cached register and is returned as -ENOEXEC by the next call that
+ * completes, for a setpoint this halves the frames per update.
+ * DAC161S997_VERIFY_EVERY_N only pays the NOP every @p every_n calls and
+ * DAC161S997_VERIFY_CONFIG_ONLY only for calls not ending with a DACCODE
+ * write, the writes left out are not checked at all.
+ *
+ * When an echo of a blocking call does not match, the ops from the first
+ * mismatching one on are sent again, up to @p retries times. A STATUS read
+ * sent again returns the bits of both reads, the first one may have cleared
+ * the sticky ones.
+ *
+ * @param[in]	dev			Device to configure
+ * @param[in]	policy		Verification of the last write of a call
+ * @param[in]	every_n		Period of DAC161S997_VERIFY_EVERY_N, ignored otherwise
+ * @param[in]	retries		Resends of a mismatching call, 0 for none
+ *
+ * @return		0			Policy set
+ * @return		-EINVAL		Unknown policy or every_n of 0
+ * @return		-ENOTSUP	The device has no context, it always verifies
+ */
+int dac161s997_set_verify(dac161s997_dev_t *dev, DAC161S997_VERIFY_t policy,
+                          uint16_t every_n, uint8_t retries);
+
+/**
+ * @brief	Takes a consistent snapshot of the counters of a device.
+ *
+ * Lock-free: the driver never waits for a reader, a snapshot taken while the
+ * device is in use is simply retried. Safe to call from a monitoring task
+ * while another one drives the device. Latencies are only measured if the
+ * port has dac161s997_timestamp_ns() and only for the blocking calls.
+ *
+ * Requires DAC161S997_STATS set to 1 when building the driver and its users,
+ * and a compiler with the GCC __atomic builtins.
+ *
+ * @param[in]	dev			Device to read the counters of
+ * @param[out]	stats		Snapshot of the counters
+ *
+ * @return		0			Snapshot taken
+ * @return		-ENOTSUP	Built without DAC161S997_STATS or the device has no context
+ */
+int dac161s997_stats_get(dac161s997_dev_t *dev, dac161s997_stats_t *stats);
+
+/**
+ * @brief	Runs a batch of register read and write ops.
+ *
+ * All frames of the batch are encoded into one contiguous buffer and clocked
+ * out back to back. The response to a frame arrives with the next frame, so
+ * a batch of n ops costs n + 1 frames, the last one being a NOP. As the chip
+ * latches a frame on the rising chip select, each frame is still handed to
+ * dac161s997_spi_xfer() on its own.
+ *
+ * Every op gets its own result in dac161s997_op_t::err. Writes are verified
+ * against the echoed data, reads store the echoed data. An empty batch sends
+ * a single NOP which only resets the SPI timeout. Whether a batch ending with
+ * a write gets the trailing NOP depends on dac161s997_set_verify().
+ *
+ * @param[in]	dev			Device to select
+ * @param[in,out]	ops		Ops to run in order, see DAC161S997_OP_READ()
+ *                          and DAC161S997_OP_WRITE()
+ * @param[in]	n			Number of ops
+ *
+ * @return		0			All ops successful
+ * @return      -ENOEXEC	The device did get expected values
+ * @return		errors from dac161s997_spi_xfer()
+ * @return		The first error of the batch if more than one op failed
+ */
+int dac161s997_xfer_batch(dac161s997_dev_t *dev, dac161s997_op_t *ops,
+                          size_t n);
+
+/**
+ * @defgroup DAC161S997_ASYNC
+ * @{
+ * @brief	Non-blocking versions of the driver calls.
+ *
+ * A start call queues the frames of the request in the device context and
+ * starts the first one with dac161s997_spi_xfer_async(). Every completion
+ * reported with dac161s997_xfer_done() starts the next frame, so many
+ * devices can be in flight from a single thread. Once the last frame is
+ * done the callback runs and dac161s997_async_result() returns the result
+ * the blocking call would have returned.
+ *
+ * Only one request can be in flight per device and the blocking calls must
+ * not be used on a device while it has one.
+ *
+ * All start calls return:
+ * @return		0			Request started
+ * @return		-ENOTSUP	No context or dac161s997_spi_xfer_async() for the device
+ * @return		-EBUSY		A request is already in flight on the device
+ * @return		-EINVAL		Value out of range
+ * @return		errors from dac161s997_spi_xfer_async()
+ */
+
+/**
+ * @brief	Starts dac161s997_init() without blocking.
+ *
+ * @param[in]	dev			Device to initialize
+ * @param[in]	cb			Completion callback, may be NULL
+ * @param[in]	arg			Argument of the callback
+ */
+int dac161s997_init_start(dac161s997_dev_t *dev, dac161s997_cb_t cb,
+                          void *arg);
+
+/**
+ * @brief	Starts dac161s997_set_output() without blocking.
+ *
+ * @param[in]	dev			Device to select
+ * @param[in]	n_amps		Current to set in nA
+ * @param[in]	cb			Completion callback, may be NULL
+ * @param[in]	arg			Argument of the callback
+ */
+int dac161s997_set_output_start(dac161s997_dev_t *dev, int32_t n_amps,
+                                dac161s997_cb_t cb, void *arg);
+
+/**
+ * @brief	Starts dac161s997_set_code() without blocking.
+ *
+ * @param[in]	dev			Device to select
+ * @param[in]	code		Uncalibrated DAC code
+ * @param[in]	cb			Completion callback, may be NULL
+ * @param[in]	arg			Argument of the callback
+ */
+int dac161s997_set_code_start(dac161s997_dev_t *dev, uint16_t code,
+                              dac161s997_cb_t cb, void *arg);
+
+/**
+ * @brief	Starts dac161s997_set_alarm() without blocking.
+ *
+ * @param[in]	dev			Device to select
+ * @param[in]	alarm		Type of alarm to set
+ * @param[in]	cb			Completion callback, may be NULL
+ * @param[in]	arg			Argument of the callback
+ */
+int dac161s997_set_alarm_start(dac161s997_dev_t *dev,
+                               DAC161S997_ALARM_t alarm,
+                               dac161s997_cb_t cb, void *arg);
+
+/**
+ * @brief	Starts dac161s997_get_status() without blocking.
+ *
+ * @param[in]	dev			Device to select
+ * @param[out]	status		Status bits of @ref I420_STATUS_MASK, valid once
+ *                          the request completed
+ * @param[in]	cb			Completion callback, may be NULL
+ * @param[in]	arg			Argument of the callback
+ */
+int dac161s997_get_status_start(dac161s997_dev_t *dev, uint32_t *status,
+                                dac161s997_cb_t cb, void *arg);
+
+/**
+ * @brief	Polls the asynchronous request of a device.
+ *
+ * @param[in]	dev			Device to poll
+ *
+ * @return		-EINPROGRESS	The request is still running
+ * @return		-ENOTSUP		The device has no context
+ * @return		-ENODATA		No request was started on the device yet
+ * @return		Result of the last completed request otherwise
+ */
+int dac161s997_async_result(dac161s997_dev_t *dev);
+/** @} */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,354 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ */
+
+/**
+ ******************************************************************************
+ * @addtogroup DRIVER
+ * @{
+ * @file			dac161s997.hpp
+ * @brief			C++17 front end of the driver
+ *
+ * Header only layer over dac161s997.h. The port is a policy class with static
+ * functions, the alarm levels, SPI timeout and write verification are
+ * constexpr configuration, and constant setpoints are converted and range
+ * checked at compile time:
+ * @code
+ * struct Spi {
+ *     static int xfer(dac161s997_dev_t *dev, uint8_t *tx_buf,
+ *                     uint8_t *rx_buf, size_t size);
+ *     static dac161s997_ctx_t *ctx(dac161s997_dev_t *dev);
+ * };
+ * DAC161S997_PORT(Spi)
+ *
+ * dac161s997::Device<Spi> loop(dev);
+ * loop.init();
+ * loop.set_output<12000000>();
+ * @endcode
+ * The C API stays available on the same devices.
+ ******************************************************************************
+ */
+
+#ifndef DAC161S997_HPP_
+#define DAC161S997_HPP_
+
+/* Includes *******************************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include "dac161s997.h"
+#include "dac161s997_port.h"
+
+/**
+ * @brief	Implements the port functions of the driver with @p Port.
+ *
+ * Must be used once, at namespace scope of a single C++ file. Port::xfer
+ * implements dac161s997_spi_xfer() and is inlined into it. If Port has a
+ * static ctx() it implements dac161s997_get_ctx(), otherwise the devices run
+ * without a context.
+ */
+#define DAC161S997_PORT(Port)                                               \
+    extern "C" int dac161s997_spi_xfer(dac161s997_dev_t *dev,               \
+                                       uint8_t *tx_buf, uint8_t *rx_buf,    \
+                                       size_t size)                         \
+    {                                                                       \
+        return Port::xfer(dev, tx_buf, rx_buf, size);                       \
+    }                                                                       \
+    extern "C" dac161s997_ctx_t *dac161s997_get_ctx(dac161s997_dev_t *dev)  \
+    {                                                                       \
+        return ::dac161s997::detail::port_ctx<Port>(dev);                   \
+    }
+
+namespace dac161s997 {
+
+/**
+ * @brief	Converts a current in nA to a DAC code at compile time.
+ *
+ * Same rounding and clamping to 0 and 0xFFFF as dac161s997_na_to_code().
+ */
+constexpr uint16_t code(int32_t n_amps)
+{
+    if (n_amps <= 0) {
+        return 0;
+    }
+    if (DAC161S997_NA_TO_CODE_RAW(n_amps) > 0xFFFF) {
+        return 0xFFFF;
+    }
+    return static_cast<uint16_t>(DAC161S997_NA_TO_CODE_RAW(n_amps));
+}
+
+/** @brief	DAC code of a current in nA that is checked to be in range */
+template <int32_t NAmps>
+inline constexpr uint16_t code_v = [] {
+    static_assert(NAmps >= static_cast<int32_t>(DAC161S997_MIN_NA) &&
+                  NAmps <= static_cast<int32_t>(DAC161S997_MAX_NA),
+                  "current out of range");
+    return code(NAmps);
+}();
+
+static_assert(code_v<static_cast<int32_t>(DAC161S997_MAX_NA)> == 0xFFFF,
+              "full scale must not wrap to 0");
+
+/**
+ * @brief	Configuration written by Device::init(), same as dac161s997_init().
+ *
+ * Derive from it and override members to change them.
+ */
+struct DefaultConfig {
+    /** Low failure level, also the output after init */
+    static constexpr int32_t alarm_low_na =
+        static_cast<int32_t>(DAC161S997_FAIL_LO_ALARM_NA);
+    /** High failure level */
+    static constexpr int32_t alarm_high_na =
+        static_cast<int32_t>(DAC161S997_FAIL_HI_ALARM_NA);
+    /** 50 to 400 ms in steps of 50 ms */
+    static constexpr uint32_t spi_timeout_ms = DAC161S997_INIT_SPI_TIMEOUT_MS;
+    static constexpr DAC161S997_VERIFY_t verify = DAC161S997_VERIFY_ALWAYS; /**< See dac161s997_set_verify() */
+    static constexpr uint16_t verify_every_n = 0;       /**< Calls per check with DAC161S997_VERIFY_EVERY_N */
+    static constexpr uint8_t verify_retries = 0;        /**< Resends of a mismatching call */
+};
+
+namespace detail {
+
+template <typename Port, typename = void>
+struct has_ctx : std::false_type {};
+
+template <typename Port>
+struct has_ctx<Port, std::void_t<decltype(Port::ctx(
+    static_cast<dac161s997_dev_t *>(nullptr)))>> : std::true_type {};
+
+template <typename Port>
+dac161s997_ctx_t *port_ctx(dac161s997_dev_t *dev)
+{
+    if constexpr (has_ctx<Port>::value) {
+        return Port::ctx(dev);
+    }
+    else {
+        (void)dev;
+        return nullptr;
+    }
+}
+
+/* Values dac161s997_init() writes, only differences are written again */
+inline constexpr uint16_t init_err_config = DAC161S997_INIT_ERR_CONFIG;
+inline constexpr uint16_t init_alarm_low =
+    code(static_cast<int32_t>(DAC161S997_FAIL_LO_ALARM_NA));
+inline constexpr uint16_t init_alarm_high =
+    code(static_cast<int32_t>(DAC161S997_FAIL_HI_ALARM_NA));
+
+/* Saturation levels of dac161s997_set_alarm() */
+inline constexpr uint16_t sat_low =
+    code(static_cast<int32_t>(DAC161S997_SAT_LO_ALARM_NA));
+inline constexpr uint16_t sat_high =
+    code(static_cast<int32_t>(DAC161S997_SAT_HI_ALARM_NA));
+
+} /* namespace detail */
+
+/**
+ * @brief	A device driven through @p Port with the configuration @p Config.
+ *
+ * Holds a pointer to the device and nothing else. Calls that are resolved at
+ * compile time go through dac161s997_set_code() without range or alarm
+ * checks at run time.
+ *
+ * @tparam	Port	Policy with a static xfer() as dac161s997_spi_xfer()
+ * @tparam	Config	Constexpr configuration like DefaultConfig
+ */
+template <typename Port, typename Config = DefaultConfig>
+class Device {
+public:
+    static_assert(std::is_invocable_r_v<int, decltype(&Port::xfer),
+                                        dac161s997_dev_t *, uint8_t *,
+                                        uint8_t *, size_t>,
+                  "Port::xfer must be like dac161s997_spi_xfer()");
+    static_assert(Config::spi_timeout_ms >= 50 &&
+                  Config::spi_timeout_ms <= 400 &&
+                  Config::spi_timeout_ms % 50 == 0,
+                  "SPI timeout must be 50 to 400 ms in steps of 50 ms");
+    static_assert(Config::alarm_low_na < Config::alarm_high_na,
+                  "low alarm must be below the high alarm");
+
+    /** DAC code of the low failure level */
+    static constexpr uint16_t alarm_low_code = code_v<Config::alarm_low_na>;
+    /** DAC code of the high failure level */
+    static constexpr uint16_t alarm_high_code = code_v<Config::alarm_high_na>;
+    /** ERR_CONFIG with the SPI timeout of the configuration */
+    static constexpr uint16_t err_config =
+        DAC161S997_ERR_CONFIG_SPI_TIMEOUT(Config::spi_timeout_ms);
+
+    explicit Device(dac161s997_dev_t &dev) : dev_(&dev) {}
+
+    /** @brief	The C device, for the rest of the C API */
+    dac161s997_dev_t *dev() const { return dev_; }
+
+    /** @brief	dac161s997_init() followed by the configuration */
+    int init() const
+    {
+        int err = dac161s997_init(dev_);
+
+        if (!err) {
+            err = configure();
+        }
+        return err;
+    }
+
+    /** @brief	Sets a constant current in nA, checked at compile time */
+    template <int32_t NAmps>
+    int set_output() const
+    {
+        return dac161s997_set_code(dev_, code_v<NAmps>);
+    }
+
+    /** @brief	dac161s997_set_output() */
+    int set_output(int32_t n_amps) const
+    {
+        return dac161s997_set_output(dev_, n_amps);
+    }
+
+    /** @brief	dac161s997_set_code() */
+    int set_code(uint16_t code) const
+    {
+        return dac161s997_set_code(dev_, code);
+    }
+
+    /** @brief	Sets an alarm level chosen at compile time */
+    template <DAC161S997_ALARM_t Alarm>
+    int set_alarm() const
+    {
+        return dac161s997_set_code(dev_, alarm_code<Alarm>());
+    }
+
+    /** @brief	dac161s997_get_status_fast() */
+    int get_status(uint32_t &status) const
+    {
+        return dac161s997_get_status_fast(dev_, &status);
+    }
+
+    /** @brief	dac161s997_audit() */
+    int audit(uint32_t &status) const
+    {
+        return dac161s997_audit(dev_, &status);
+    }
+
+    /** @brief	dac161s997_recover() */
+    int recover() const
+    {
+        return dac161s997_recover(dev_);
+    }
+
+    /**
+     * @brief	dac161s997_xfer_batch() of a contiguous range of ops.
+     *
+     * @param[in,out]	ops		For example a std::span<dac161s997_op_t>
+     */
+    template <typename Ops>
+    int xfer(Ops &&ops) const
+    {
+        return dac161s997_xfer_batch(dev_, std::data(ops), std::size(ops));
+    }
+
+    /**
+     * @brief	dac161s997_set_outputs() of contiguous ranges.
+     *
+     * @param[in]	devices		Devices, for example a std::span<const Device>
+     * @param[in]	n_amps		Current to set in nA, one per device
+     * @param[out]	err_map		Channels that failed, DAC161S997_ERR_MAP_WORDS() words
+     */
+    template <typename Devices, typename Amps>
+    static int set_outputs(const Devices &devices, const Amps &n_amps,
+                           uint32_t *err_map)
+    {
+        int err;
+        int first_err = 0;
+        dac161s997_dev_t *devs[32];
+        const size_t n = std::size(devices);
+        const int32_t *amps = std::data(n_amps);
+
+        if (std::size(n_amps) != n) {
+            return -EINVAL;
+        }
+        /* One error map word at a time, the C API needs device pointers */
+        for (size_t base = 0; base < n; base += 32) {
+            size_t count = (n - base < 32) ? n - base : 32;
+
+            for (size_t i = 0; i < count; i++) {
+                devs[i] = std::data(devices)[base + i].dev();
+            }
+            err = dac161s997_set_outputs(devs, &amps[base], count,
+                                         &err_map[base / 32]);
+            if (err && !first_err) {
+                first_err = err;
+            }
+        }
+        return first_err;
+    }
+
+private:
+    template <DAC161S997_ALARM_t Alarm>
+    static constexpr uint16_t alarm_code()
+    {
+        static_assert(Alarm != DAC161S997_ALARM_UNINIT,
+                      "the uninitialized level cannot be set");
+        if constexpr (Alarm == DAC161S997_ALARM_LOW_FAIL) {
+            return alarm_low_code;
+        }
+        else if constexpr (Alarm == DAC161S997_ALARM_LOW_SAT) {
+            return detail::sat_low;
+        }
+        else if constexpr (Alarm == DAC161S997_ALARM_HIGH_SAT) {
+            return detail::sat_high;
+        }
+        else {
+            return alarm_high_code;
+        }
+    }
+
+    uint16_t calibrated(uint16_t code) const
+    {
+        dac161s997_ctx_t *ctx = detail::port_ctx<Port>(dev_);
+
+        return (ctx && ctx->cal) ? dac161s997_cal_apply(ctx->cal, code) : code;
+    }
+
+    int configure() const
+    {
+        int err = 0;
+        size_t n = 0;
+        dac161s997_op_t ops[4];
+
+        if constexpr (err_config != detail::init_err_config) {
+            ops[n++] = DAC161S997_OP_WRITE(DAC161S997_ERR_CONFIG_REG,
+                                           err_config);
+        }
+        if constexpr (alarm_low_code != detail::init_alarm_low) {
+            ops[n++] = DAC161S997_OP_WRITE(DAC161S997_ERR_LOW_REG,
+                                           calibrated(alarm_low_code));
+            ops[n++] = DAC161S997_OP_WRITE(DAC161S997_DACCODE_REG,
+                                           calibrated(alarm_low_code));
+        }
+        if constexpr (alarm_high_code != detail::init_alarm_high) {
+            ops[n++] = DAC161S997_OP_WRITE(DAC161S997_ERR_HIGH_REG,
+                                           calibrated(alarm_high_code));
+        }
+        if (n) {
+            err = dac161s997_xfer_batch(dev_, ops, n);
+        }
+        if constexpr (Config::verify != DAC161S997_VERIFY_ALWAYS ||
+                      Config::verify_retries) {
+            if (!err) {
+                err = dac161s997_set_verify(dev_, Config::verify,
+                                            Config::verify_every_n,
+                                            Config::verify_retries);
+            }
+        }
+        return err;
+    }
+
+    dac161s997_dev_t *dev_;
+};
+
+} /* namespace dac161s997 */
+
+#endif /* DAC161S997_HPP_ */
+/** @} */
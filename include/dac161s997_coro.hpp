@@ -0,0 +1,113 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ */
+
+/**
+ ******************************************************************************
+ * @addtogroup DRIVER
+ * @{
+ * @file			dac161s997_coro.hpp
+ * @brief			C++20 coroutine adapter of the asynchronous driver API
+ *
+ * Wraps the start calls of @ref DAC161S997_ASYNC into awaitables, so a
+ * coroutine can write
+ * @code
+ * int err = co_await dac161s997::set_output(dev, 12000000);
+ * @endcode
+ * The coroutine is resumed from the context calling dac161s997_xfer_done().
+ ******************************************************************************
+ */
+
+#ifndef DAC161S997_CORO_HPP_
+#define DAC161S997_CORO_HPP_
+
+/* Includes *******************************************************************/
+#include <coroutine>
+#include <cstdint>
+#include "dac161s997.h"
+
+namespace dac161s997 {
+
+/**
+ * @brief	Awaitable of a single asynchronous request.
+ *
+ * @tparam	Start	Callable starting the request with a callback and argument
+ */
+template <typename Start>
+class Request {
+public:
+    Request(dac161s997_dev_t *dev, Start start) : dev_(dev), start_(start) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+        handle_ = handle;
+        int err = start_(dev_, &Request::done, this);
+        if (err) {
+            result_ = err;
+            return false;
+        }
+        /* The request may already be done and this destroyed, hands off */
+        return true;
+    }
+
+    int await_resume() const noexcept { return result_; }
+
+private:
+    static void done(dac161s997_dev_t *, int err, void *arg)
+    {
+        auto *self = static_cast<Request *>(arg);
+
+        self->result_ = err;
+        self->handle_.resume();
+    }
+
+    dac161s997_dev_t *dev_;
+    Start start_;
+    std::coroutine_handle<> handle_;
+    int result_ = 0;
+};
+
+/** @brief	Awaitable dac161s997_init() */
+inline auto init(dac161s997_dev_t *dev)
+{
+    auto start = [](dac161s997_dev_t *d, dac161s997_cb_t cb, void *arg) {
+        return dac161s997_init_start(d, cb, arg);
+    };
+    return Request<decltype(start)>(dev, start);
+}
+
+/** @brief	Awaitable dac161s997_set_output() */
+inline auto set_output(dac161s997_dev_t *dev, int32_t n_amps)
+{
+    auto start = [n_amps](dac161s997_dev_t *d, dac161s997_cb_t cb,
+                          void *arg) {
+        return dac161s997_set_output_start(d, n_amps, cb, arg);
+    };
+    return Request<decltype(start)>(dev, start);
+}
+
+/** @brief	Awaitable dac161s997_set_alarm() */
+inline auto set_alarm(dac161s997_dev_t *dev, DAC161S997_ALARM_t alarm)
+{
+    auto start = [alarm](dac161s997_dev_t *d, dac161s997_cb_t cb, void *arg) {
+        return dac161s997_set_alarm_start(d, alarm, cb, arg);
+    };
+    return Request<decltype(start)>(dev, start);
+}
+
+/** @brief	Awaitable dac161s997_get_status(), @p status is valid on resume */
+inline auto get_status(dac161s997_dev_t *dev, uint32_t *status)
+{
+    auto start = [status](dac161s997_dev_t *d, dac161s997_cb_t cb,
+                          void *arg) {
+        return dac161s997_get_status_start(d, status, cb, arg);
+    };
+    return Request<decltype(start)>(dev, start);
+}
+
+} /* namespace dac161s997 */
+
+#endif /* DAC161S997_CORO_HPP_ */
+/** @} */
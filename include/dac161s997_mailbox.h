@@ -0,0 +1,202 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ */
+
+/**
+ ******************************************************************************
+ * @addtogroup DRIVER
+ * @{
+ * @file			dac161s997_mailbox.h
+ * @brief			Lock-free setpoint mailbox of a dac161s997 device
+ *
+ * Any number of producers post setpoints and alarm requests without ever
+ * waiting for the bus, a single worker owning the device drains the mailbox
+ * and puts only the latest request on the wire. A posted setpoint replaces
+ * the one not sent yet. A raised alarm is latched and takes priority over
+ * setpoints until it is cleared, the setpoints posted meanwhile are kept and
+ * the latest one is restored on clear.
+ *
+ * Posting is a single atomic exchange on a 32 bit word, so it is lock-free on
+ * any target with 32 bit atomics and may be done from interrupts. Requires
+ * the GCC __atomic builtins.
+ *
+ * A setpoint slot is the cheaper variant for a single producer, typically a
+ * control loop running in a timer interrupt. Posting converts the current to
+ * a DAC code and publishes it together with a sequence number in one plain
+ * 32 bit store, no read-modify-write, so it stays wait-free on cores without
+ * atomic instructions. A task or the SPI completion handler flushes the
+ * latest code to the bus, codes posted in between are dropped.
+ ******************************************************************************
+ */
+
+#ifndef DAC161S997_MAILBOX_H_
+#define DAC161S997_MAILBOX_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include "dac161s997.h"
+
+/* Typedefs *******************************************************************/
+typedef struct {
+    uint32_t setpoint;      /**< Setpoint posted and not drained yet, private */
+    uint32_t alarm;         /**< Alarm request posted and not drained yet, private */
+    uint32_t coalesced;     /**< Requests replaced before being drained */
+    int32_t held_na;        /**< Latest drained setpoint, worker only */
+    uint16_t latched;       /**< Alarm latched, 0 if none, worker only */
+    uint8_t has_held;       /**< held_na is valid, worker only */
+    uint8_t dirty;          /**< The device does not match yet, worker only */
+} dac161s997_mailbox_t;     /**< Mailbox of a single device */
+
+typedef struct {
+    uint32_t latest;        /**< Sequence in the upper half, code in the lower half, private */
+    uint32_t flushed;       /**< Sequence and code on the device, flusher only */
+    uint32_t in_flight;     /**< Sequence and code being sent, flusher only */
+    uint32_t coalesced;     /**< Codes replaced before being flushed, flusher only */
+} dac161s997_slot_t;        /**< Setpoint slot of a single device */
+
+/* Function prototypes ********************************************************/
+/**
+ * @brief	Initializes an empty mailbox.
+ *
+ * @param[out]	mb			Mailbox to initialize
+ */
+void dac161s997_mailbox_init(dac161s997_mailbox_t *mb);
+
+/**
+ * @brief	Posts a setpoint, replacing the one not drained yet.
+ *
+ * Wait-free, safe from any thread or interrupt.
+ *
+ * @param[in,out]	mb		Mailbox of the device
+ * @param[in]	n_amps		Current to set in nA
+ *
+ * @return		0			Setpoint posted
+ * @return		-EINVAL		Value out of range, nothing posted
+ */
+int dac161s997_mailbox_post(dac161s997_mailbox_t *mb, int32_t n_amps);
+
+/**
+ * @brief	Posts an alarm, latched until dac161s997_mailbox_clear_alarm().
+ *
+ * Wait-free, safe from any thread or interrupt.
+ *
+ * @param[in,out]	mb		Mailbox of the device
+ * @param[in]	alarm		Type of alarm to set
+ *
+ * @return		0			Alarm posted
+ * @return		-EINVAL		Unknown alarm, nothing posted
+ */
+int dac161s997_mailbox_alarm(dac161s997_mailbox_t *mb,
+                             DAC161S997_ALARM_t alarm);
+
+/**
+ * @brief	Posts the release of the latched alarm.
+ *
+ * The latest setpoint goes back on the wire. An alarm that is raised and
+ * cleared before the worker drains the mailbox never reaches the device.
+ *
+ * @param[in,out]	mb		Mailbox of the device
+ */
+void dac161s997_mailbox_clear_alarm(dac161s997_mailbox_t *mb);
+
+/**
+ * @brief	Puts the latest request of a mailbox on the wire.
+ *
+ * Must only be called by the single worker driving the device. A request
+ * failing on the bus is tried again on the next drain unless a newer one
+ * replaced it.
+ *
+ * @pre		Device must be initialized with dac161s997_init
+ *
+ * @param[in]	dev			Device of the mailbox
+ * @param[in,out]	mb		Mailbox to drain
+ *
+ * @return		0			Device up to date, or nothing to do
+ * @return		errors from dac161s997_set_output() and dac161s997_set_alarm()
+ */
+int dac161s997_mailbox_drain(dac161s997_dev_t *dev, dac161s997_mailbox_t *mb);
+
+/**
+ * @brief	Initializes an empty setpoint slot.
+ *
+ * @param[out]	slot		Slot to initialize
+ */
+void dac161s997_slot_init(dac161s997_slot_t *slot);
+
+/**
+ * @brief	Posts a setpoint, replacing the one not flushed yet.
+ *
+ * Wait-free and inline, meant for interrupts. Only one context may post to a
+ * slot. The sequence number is 16 bit, so coalesced only stays exact if the
+ * slot is flushed at least once every 65535 posts, the latest code is written
+ * either way.
+ *
+ * @param[in,out]	slot	Slot of the device
+ * @param[in]	n_amps		Current to set in nA
+ *
+ * @return		0			Setpoint posted
+ * @return		-EINVAL		Value out of range, nothing posted
+ */
+static inline int dac161s997_slot_post(dac161s997_slot_t *slot,
+                                       int32_t n_amps)
+{
+    uint32_t seq;
+
+    if (!dac161s997_na_valid(n_amps)) {
+        return -EINVAL;
+    }
+    /* Only this context writes the word, reading it back needs no atomicity */
+    seq = (__atomic_load_n(&slot->latest, __ATOMIC_RELAXED) + 0x10000UL) &
+          0xFFFF0000UL;
+    /* Saturates at 0xFFFF, full scale must not carry into the sequence */
+    __atomic_store_n(&slot->latest, seq | DAC161S997_NA_TO_CODE(n_amps),
+                     __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * @brief	Writes the latest code of a slot to the device.
+ *
+ * Must only be called by the single flusher of the slot. A code failing on
+ * the bus is tried again on the next flush unless a newer one replaced it.
+ *
+ * @pre		Device must be initialized with dac161s997_init
+ *
+ * @param[in]	dev			Device of the slot
+ * @param[in,out]	slot	Slot to flush
+ *
+ * @return		0			Device up to date, or nothing to do
+ * @return		errors from dac161s997_set_code()
+ */
+int dac161s997_slot_flush(dac161s997_dev_t *dev, dac161s997_slot_t *slot);
+
+/**
+ * @brief	Starts writing the latest code of a slot without blocking.
+ *
+ * Same as dac161s997_slot_flush() through dac161s997_set_code_start(), so it
+ * can be called from the handler that reports the end of the previous
+ * request with dac161s997_xfer_done(). dac161s997_async_result() returns the
+ * result once done.
+ *
+ * @param[in]	dev			Device of the slot
+ * @param[in,out]	slot	Slot to flush
+ *
+ * @return		0			Write started
+ * @return		-EALREADY	Device up to date, nothing started
+ * @return		errors from dac161s997_set_code_start()
+ */
+int dac161s997_slot_flush_start(dac161s997_dev_t *dev,
+                                dac161s997_slot_t *slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DAC161S997_MAILBOX_H_ */
+/** @} */
@@ -27,6 +27,27 @@ extern "C" {
 #include <stddef.h>
 #include "dac161s997_types.h"
 
+/* Defines ********************************************************************/
+/**
+ * @brief	Marks a port function that may be left unimplemented.
+ *
+ * The driver checks whether an optional function has been linked before using
+ * it. This relies on weak symbols, with toolchains not supporting them all
+ * functions of the port must be implemented.
+ */
+#if defined(__GNUC__)
+#define DAC161S997_PORT_OPTIONAL    __attribute__((weak))
+#else
+#define DAC161S997_PORT_OPTIONAL
+#endif
+
+/* Typedefs *******************************************************************/
+typedef struct {
+    uint8_t *tx_buf;        /**< Bytes to send on MOSI */
+    uint8_t *rx_buf;        /**< Bytes read from MISO */
+    size_t size;            /**< Number of bytes of the segment */
+    uint8_t cs_change;      /**< Release chip select after the segment */
+} dac161s997_spi_seg_t;     /**< A segment of a vectored SPI transfer */
 
 /* Function prototypes ********************************************************/
 /**
@@ -51,8 +72,162 @@ extern "C" {
  */
 int dac161s997_spi_xfer(dac161s997_dev_t *dev, uint8_t *tx_buf,
                             uint8_t *rx_buf, size_t size);
+
+/**
+ * @brief	Gets the driver context of a device.
+ *
+ * The context lets the driver keep a shadow copy of the chip registers, which
+ * saves redundant writes and read backs. It is usually a member of the user
+ * defined dac161s997_dev_t and must be zero initialized.
+ *
+ * @param[in]	dev			Device to get the context of
+ *
+ * @return		Context of the device, NULL to run the device without one
+ *
+ * @note Optional, without it the driver does not keep any state.
+ */
+DAC161S997_PORT_OPTIONAL
+dac161s997_ctx_t *dac161s997_get_ctx(dac161s997_dev_t *dev);
+
+/**
+ * @brief	Gets a monotonic timestamp.
+ *
+ * Used to skip the wait between two frames when enough time has already
+ * passed, and to track how long ago each device has seen a frame.
+ *
+ * @return		Time in ns, must not be 0 once the driver is in use
+ *
+ * @note Optional, without it the driver always waits with
+ *       dac161s997_delay_ns() between frames and cannot tell when a device
+ *       needs a keepalive.
+ */
+DAC161S997_PORT_OPTIONAL
+uint64_t dac161s997_timestamp_ns(void);
+
+/**
+ * @brief	Waits at least the given time.
+ *
+ * Used to keep chip select high for DAC161S997_MIN_CS_HIGH_NS between two
+ * frames.
+ *
+ * @param[in]	ns			Time to wait in ns
+ *
+ * @note Optional, without it the driver spins on dac161s997_timestamp_ns()
+ *       if provided, or does not wait at all.
+ */
+DAC161S997_PORT_OPTIONAL
+void dac161s997_delay_ns(uint32_t ns);
+
+/**
+ * @brief	Starts an SPI transfer without waiting for it to finish.
+ *
+ * Same as dac161s997_spi_xfer() but returns as soon as the transfer has been
+ * started, for example on a DMA or interrupt driven SPI. Once the transfer
+ * is finished and chip select is released the port must report it with
+ * dac161s997_xfer_done(). The buffers stay valid until then.
+ *
+ * @param[in]	dev			Device to xfer
+ * @param[in]	tx_buf		Bytes to send on MOSI
+ * @param[out]	rx_buf		Bytes read from MISO
+ * @param[in]	size		Number of bytes to xfer
+ *
+ * @return		0			Transfer started
+ * @return      depends on user implementation, dac161s997_xfer_done() must
+ *              not be called if the transfer did not start
+ *
+ * @note Optional, needed by the asynchronous API only.
+ */
+DAC161S997_PORT_OPTIONAL
+int dac161s997_spi_xfer_async(dac161s997_dev_t *dev, uint8_t *tx_buf,
+                              uint8_t *rx_buf, size_t size);
+
+/**
+ * @brief	Runs several SPI transfers in one call.
+ *
+ * Clocks the segments in order. Chip select is released after every segment
+ * with dac161s997_spi_seg_t::cs_change set, for at least
+ * DAC161S997_MIN_CS_HIGH_NS, and always after the last one. The driver sends
+ * one frame per segment, so a port that can queue the whole vector, such as
+ * a single SPI_IOC_MESSAGE() on Linux spidev, saves a call per frame.
+ *
+ * @param[in]	dev			Device to xfer
+ * @param[in]	segs		Segments to clock
+ * @param[in]	n			Number of segments
+ *
+ * @return		0			All segments transferred
+ * @return      depends on user implementation, the driver considers all
+ *              segments lost on error
+ *
+ * @note Optional, without it dac161s997_spi_xfer() is called per frame.
+ */
+DAC161S997_PORT_OPTIONAL
+int dac161s997_spi_xfer_vec(dac161s997_dev_t *dev,
+                            const dac161s997_spi_seg_t *segs, size_t n);
+
+/**
+ * @brief	Sends the same bytes to several devices at once.
+ *
+ * Asserts the chip selects of all devices together, clocks @p tx_buf and
+ * releases them together. MISO is not read as all chips drive it at once.
+ * Used for the XFR commit of dac161s997_set_outputs_sync(), so the outputs
+ * of the group change at the same instant.
+ *
+ * @param[in]	devs		Devices to select
+ * @param[in]	n			Number of devices, 2 to 32
+ * @param[in]	tx_buf		Bytes to send on MOSI
+ * @param[in]	size		Number of bytes to xfer
+ *
+ * @return		0			Transfer done
+ * @return		-ENOTSUP	These devices cannot be selected together, the
+ *                          driver sends the frame to one device at a time
+ * @return      depends on user implementation, the driver considers the
+ *              frame lost on all devices on error
+ *
+ * @note Optional, without it the commit frames go out back to back.
+ */
+DAC161S997_PORT_OPTIONAL
+int dac161s997_spi_xfer_multi(dac161s997_dev_t *const *devs, size_t n,
+                              uint8_t *tx_buf, size_t size);
+
+/**
+ * @brief	Sends one frame to each of several devices in a single call.
+ *
+ * Selects the devices one after the other, clocking @p size bytes of
+ * @p tx_buf to each and reading its MISO into @p rx_buf at the same offset,
+ * with chip select released after each frame. Used by
+ * dac161s997_set_outputs() so a fleet update costs two port calls per 32
+ * channels instead of two per channel.
+ *
+ * @param[in]	devs		Devices to access, in order
+ * @param[in]	n			Number of devices, 2 to 32
+ * @param[in]	tx_buf		@p n frames of @p size bytes, frame i to device i
+ * @param[out]	rx_buf		@p n frames of @p size bytes received
+ * @param[in]	size		Number of bytes per frame
+ *
+ * @return		0			Transfer done
+ * @return		-ENOTSUP	These devices cannot be accessed together, the
+ *                          driver sends the frames one device at a time
+ * @return      depends on user implementation, the driver considers all
+ *              frames lost on error
+ *
+ * @note Optional, without it the frames go out one call per device.
+ */
+DAC161S997_PORT_OPTIONAL
+int dac161s997_spi_xfer_each(dac161s997_dev_t *const *devs, size_t n,
+                             uint8_t *tx_buf, uint8_t *rx_buf, size_t size);
 /** @} */
 
+/**
+ * @brief	Reports the end of a dac161s997_spi_xfer_async() transfer.
+ *
+ * Provided by the driver. Starts the next frame of the request or completes
+ * it. Safe to call from the interrupt that signals the end of the transfer.
+ *
+ * @param[in]	dev			Device of the finished transfer
+ * @param[in]	err			0 if the transfer succeeded, error otherwise
+ */
+void dac161s997_xfer_done(dac161s997_dev_t *dev, int err);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ */
+
+/**
+ ******************************************************************************
+ * @addtogroup DRIVER
+ * @{
+ * @file			dac161s997_sched.h
+ * @brief			Timed setpoint schedules for many dac161s997 devices
+ *
+ * A schedule gives each channel a column of sample times and a column of
+ * setpoints in nA. The columns are handed to the player in blocks of any
+ * size, for example straight out of a memory mapped file, and never copied:
+ * dac161s997_sched_convert() turns the next DAC161S997_SCHED_DEPTH samples
+ * of each channel into DAC codes ahead of time, so dispatching a due sample
+ * only costs its SPI write. Memory use does not depend on the length of the
+ * schedule.
+ *
+ * Channels are kept in a heap ordered by their next sample, and only the
+ * channels that were fed or dispatched are converted again, so the cost per
+ * sample grows with the log of the number of channels.
+ *
+ * A schedule file is a dac161s997_sched_hdr_t, a dac161s997_sched_col_t per
+ * channel and the columns, all in host byte order. tools/sched plays such
+ * files on the emulator.
+ ******************************************************************************
+ */
+
+#ifndef DAC161S997_SCHED_H_
+#define DAC161S997_SCHED_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include "dac161s997.h"
+
+/* Defines ********************************************************************/
+#ifndef DAC161S997_SCHED_DEPTH
+#define DAC161S997_SCHED_DEPTH      16  /**< Samples converted ahead per channel, a power of two */
+#endif
+
+#define DAC161S997_SCHED_MAGIC      "D161SCH1"  /**< First bytes of a schedule file */
+#define DAC161S997_SCHED_VERSION    1           /**< Version of the file format */
+
+/* Typedefs *******************************************************************/
+typedef struct {
+    dac161s997_dev_t *dev;      /**< Device of the channel */
+    const uint64_t *ts_ns;      /**< Sample times of the block, private */
+    const int32_t *n_amps;      /**< Setpoints of the block, private */
+    size_t n;                   /**< Samples in the block, private */
+    size_t pos;                 /**< Samples of the block converted */
+    uint64_t due_ns[DAC161S997_SCHED_DEPTH];    /**< Converted sample times, private */
+    uint16_t codes[DAC161S997_SCHED_DEPTH];     /**< Converted setpoints, private */
+    uint32_t head;              /**< Samples converted, private */
+    uint32_t tail;              /**< Samples dispatched or skipped, private */
+    uint32_t heap;              /**< Channel at this position of the heap, private */
+    uint32_t todo;              /**< Channel at this position of the todo stack, private */
+    uint8_t queued;             /**< The channel is on the todo stack, private */
+} dac161s997_sched_chan_t;      /**< A channel of a schedule */
+
+typedef struct {
+    uint64_t sent;          /**< Samples written to their device */
+    uint64_t late;          /**< Samples written more than late_ns after their time */
+    uint64_t skipped;       /**< Samples overtaken by a later one before they were written */
+    uint64_t invalid;       /**< Samples out of range, dropped when converted */
+    uint64_t failed;        /**< Samples whose write failed */
+    uint64_t late_max_ns;   /**< Longest delay of a written sample */
+    uint64_t late_sum_ns;   /**< Sum of the delays of the written samples */
+} dac161s997_sched_stats_t; /**< Accounting of a schedule */
+
+typedef struct {
+    dac161s997_sched_chan_t *chans;     /**< Channels, private */
+    size_t n;                           /**< Number of channels */
+    size_t n_heap;                      /**< Channels with a converted sample, private */
+    size_t n_todo;                      /**< Channels to convert, private */
+    uint64_t start_ns;                  /**< Time of sample time 0 */
+    uint64_t late_ns;                   /**< Delay after which a sample counts as late */
+    dac161s997_sched_stats_t stats;     /**< Accounting since dac161s997_sched_init() */
+} dac161s997_sched_t;                   /**< Setpoint schedule player */
+
+typedef struct {
+    char magic[8];          /**< DAC161S997_SCHED_MAGIC without the terminator */
+    uint32_t version;       /**< DAC161S997_SCHED_VERSION */
+    uint32_t n_chans;       /**< Number of channels */
+} dac161s997_sched_hdr_t;   /**< Header of a schedule file */
+
+typedef struct {
+    uint64_t n;             /**< Samples of the channel */
+    uint64_t ts_off;        /**< File offset of the uint64_t sample times in ns, 8 byte aligned */
+    uint64_t na_off;        /**< File offset of the int32_t setpoints in nA, 4 byte aligned */
+} dac161s997_sched_col_t;   /**< Columns of a channel in a schedule file */
+
+/* Function prototypes ********************************************************/
+/**
+ * @brief	Sets up a player without samples.
+ *
+ * @param[out]	sched		Player to set up
+ * @param[out]	chans		Channels, one per device
+ * @param[in]	devs		Device of each channel
+ * @param[in]	n			Number of channels
+ * @param[in]	late_ns		Delay after which a written sample counts as late
+ */
+void dac161s997_sched_init(dac161s997_sched_t *sched,
+                           dac161s997_sched_chan_t *chans,
+                           dac161s997_dev_t *const *devs, size_t n,
+                           uint64_t late_ns);
+
+/**
+ * @brief	Hands the next block of samples of a channel to the player.
+ *
+ * The block is read in place until it is converted, sample times are in ns
+ * from the start and must not decrease.
+ *
+ * @param[in,out]	sched	Player
+ * @param[in]	ch			Channel
+ * @param[in]	ts_ns		Sample times in ns
+ * @param[in]	n_amps		Setpoints in nA
+ * @param[in]	n			Number of samples
+ *
+ * @return		0			Block queued
+ * @return		-EINVAL		@p ch is not a channel
+ * @return		-EBUSY		The previous block is not converted yet
+ */
+int dac161s997_sched_feed(dac161s997_sched_t *sched, size_t ch,
+                          const uint64_t *ts_ns, const int32_t *n_amps,
+                          size_t n);
+
+/**
+ * @brief	Tells whether a channel has converted all of its block.
+ *
+ * @param[in]	sched		Player
+ * @param[in]	ch			Channel
+ *
+ * @return		Non zero if the channel takes a new block
+ */
+int dac161s997_sched_hungry(const dac161s997_sched_t *sched, size_t ch);
+
+/**
+ * @brief	Converts samples ahead of time.
+ *
+ * Fills the channels fed or dispatched since the last call up to
+ * DAC161S997_SCHED_DEPTH converted samples, meant to be called between two
+ * dispatches.
+ *
+ * @param[in,out]	sched	Player
+ *
+ * @return		Number of these channels that take a new block
+ */
+size_t dac161s997_sched_convert(dac161s997_sched_t *sched);
+
+/**
+ * @brief	Tells when the next converted sample is due.
+ *
+ * @param[in]	sched		Player
+ *
+ * @return		Time of the next sample, same clock as start_ns
+ * @return		UINT64_MAX if no sample is converted
+ */
+uint64_t dac161s997_sched_next_due(const dac161s997_sched_t *sched);
+
+/**
+ * @brief	Writes the samples that are due.
+ *
+ * Channels are written in the order their samples are due. Each gets the
+ * latest of its converted samples that is due at @p now_ns, the ones it
+ * overtakes are counted as skipped. A failing channel does not stop the
+ * others.
+ *
+ * @pre		Devices must be initialized with dac161s997_init
+ *
+ * @param[in,out]	sched	Player
+ * @param[in]	now_ns		Current time, same clock as start_ns
+ *
+ * @return		0			No errors occurred
+ * @return		errors from dac161s997_set_code() of the first failed channel
+ */
+int dac161s997_sched_dispatch(dac161s997_sched_t *sched, uint64_t now_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DAC161S997_SCHED_H_ */
+/** @} */
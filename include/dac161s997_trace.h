@@ -0,0 +1,133 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ */
+
+/**
+ ******************************************************************************
+ * @addtogroup DRIVER
+ * @{
+ * @file			dac161s997_trace.h
+ * @brief			Recorder of the SPI frames of dac161s997 devices
+ *
+ * A device attached to a trace appends a fixed size record for every frame it
+ * sends and for the start of every driver call to a ring buffer. The driver
+ * is the only producer and never waits, a record that does not fit is
+ * dropped and counted. A task off the hot path reads the ring, for example
+ * to write a trace file: a dac161s997_trace_hdr_t followed by the records.
+ * tools/trace replays such a file through the driver.
+ *
+ * The ring is single producer single consumer: all devices attached to the
+ * same trace must be driven from the same context, or the calls serialized.
+ * Requires the GCC __atomic builtins.
+ ******************************************************************************
+ */
+
+#ifndef DAC161S997_TRACE_H_
+#define DAC161S997_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include "dac161s997.h"
+
+/* Defines ********************************************************************/
+#define DAC161S997_TRACE_MAGIC      "D161TRC1"  /**< First bytes of a trace file */
+#define DAC161S997_TRACE_VERSION    1           /**< Version of the record format */
+
+/**
+ * @defgroup DAC161S997_TRACE_FLAG
+ * @{
+ */
+#define DAC161S997_TRACE_ERR        0x8000  /**< The port failed the frame, rx is not valid */
+#define DAC161S997_TRACE_CALL       0x4000  /**< Start of a driver call, not a frame */
+#define DAC161S997_TRACE_DEV_MASK   0x3FFF  /**< Id of the device */
+/** @} */
+
+/* Typedefs *******************************************************************/
+typedef enum {
+    DAC161S997_TRACE_CALL_BATCH = 0,    /**< dac161s997_xfer_batch() or its start call */
+    DAC161S997_TRACE_CALL_READ,         /**< Pipelined read of dac161s997_get_status_fast() */
+    DAC161S997_TRACE_CALL_FRAME,        /**< Single frame, as sent by the waveform player */
+} DAC161S997_TRACE_CALL_t;  /**< Kind of driver call in tx[0] of a call record */
+
+typedef struct {
+    uint64_t ts_ns;     /**< End of the frame or start of the call, 0 without dac161s997_timestamp_ns() */
+    uint16_t dev;       /**< Device id and @ref DAC161S997_TRACE_FLAG */
+    uint8_t tx[3];      /**< Frame sent, for a call the kind and the number of ops, big endian */
+    uint8_t rx[3];      /**< Frame received, 0 for a call */
+} dac161s997_trace_rec_t;   /**< A record of a trace, 16 bytes */
+
+typedef struct {
+    char magic[8];      /**< DAC161S997_TRACE_MAGIC without the terminator */
+    uint32_t version;   /**< DAC161S997_TRACE_VERSION */
+    uint32_t rec_size;  /**< sizeof(dac161s997_trace_rec_t) */
+} dac161s997_trace_hdr_t;   /**< Header of a trace file, in host byte order */
+
+typedef struct dac161s997_trace {
+    dac161s997_trace_rec_t *recs;   /**< Ring buffer, private */
+    uint32_t mask;      /**< Records in the ring minus one, private */
+    uint32_t head;      /**< Records written, private */
+    uint32_t tail;      /**< Records read, private */
+    uint32_t dropped;   /**< Records that did not fit */
+} dac161s997_trace_t;   /**< Ring of trace records */
+
+/* Function prototypes ********************************************************/
+/**
+ * @brief	Initializes an empty trace.
+ *
+ * @param[out]	trace		Trace to initialize
+ * @param[in]	recs		Buffer of the ring
+ * @param[in]	n			Records in @p recs, a power of two
+ *
+ * @return		0			Trace initialized
+ * @return		-EINVAL		@p n is not a power of two
+ */
+int dac161s997_trace_init(dac161s997_trace_t *trace,
+                          dac161s997_trace_rec_t *recs, uint32_t n);
+
+/**
+ * @brief	Starts or stops recording the frames of a device.
+ *
+ * @param[in]	dev			Device to record
+ * @param[in]	trace		Trace to append to, NULL to stop recording
+ * @param[in]	id			Id of the device in the records
+ *
+ * @return		0			Recording started or stopped
+ * @return		-EINVAL		@p id does not fit DAC161S997_TRACE_DEV_MASK
+ * @return		-ENOTSUP	The device has no context
+ */
+int dac161s997_trace_attach(dac161s997_dev_t *dev, dac161s997_trace_t *trace,
+                            uint16_t id);
+
+/**
+ * @brief	Takes the oldest records out of a trace.
+ *
+ * Wait-free, must only be called from one context at a time.
+ *
+ * @param[in,out]	trace	Trace to read
+ * @param[out]	recs		Records read
+ * @param[in]	n			Max records to read
+ *
+ * @return		Number of records read
+ */
+size_t dac161s997_trace_read(dac161s997_trace_t *trace,
+                             dac161s997_trace_rec_t *recs, size_t n);
+
+/**
+ * @brief	Fills the header of a trace file.
+ *
+ * @param[out]	hdr			Header to fill
+ */
+void dac161s997_trace_hdr(dac161s997_trace_hdr_t *hdr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DAC161S997_TRACE_H_ */
+/** @} */
@@ -32,6 +32,13 @@ extern "C" {
  * @Warning Must be defined during port!
  */
 typedef struct dac161s997_dev_t dac161s997_dev_t;
+
+/**
+ * @brief	Forward declaration of the dac161s997_ctx_t type.
+ *
+ * Driver owned state of a single chip, see dac161s997_get_ctx().
+ */
+typedef struct dac161s997_ctx dac161s997_ctx_t;
 /** @} */
 
 #ifdef __cplusplus
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ */
+
+/**
+ ******************************************************************************
+ * @addtogroup DRIVER
+ * @{
+ * @file			dac161s997_wave.h
+ * @brief			Waveform streaming for the dac161s997 driver
+ *
+ * A waveform is a buffer of DACCODE frames that are encoded when the profile
+ * is built, so streaming it costs one SPI frame per tick and no conversion.
+ * Each frame also clocks out the echo of the previous one, which is checked
+ * on the fly.
+ *
+ * The frames are contiguous in dac161s997_wave_t::frames, so a port able to
+ * pulse chip select between frames can also hand the whole buffer to a DMA.
+ ******************************************************************************
+ */
+
+#ifndef DAC161S997_WAVE_H_
+#define DAC161S997_WAVE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include "dac161s997.h"
+
+/* Defines ********************************************************************/
+/** Bytes of buffer needed for a waveform of @p n samples */
+#define DAC161S997_WAVE_BUF_SIZE(n)     ((n) * 3)
+
+/* Typedefs *******************************************************************/
+typedef struct {
+    uint8_t *frames;        /**< Encoded DACCODE frames, 3 bytes each */
+    size_t len;             /**< Number of frames in the waveform */
+    size_t max;             /**< Number of frames the buffer can hold */
+    size_t pos;             /**< Next frame to send */
+    uint8_t rx_buf[3];      /**< Echo received with the last frame */
+} dac161s997_wave_t;        /**< A precomputed waveform */
+
+/* Function prototypes ********************************************************/
+/**
+ * @brief	Initializes an empty waveform.
+ *
+ * @param[out]	wave		Waveform to initialize
+ * @param[in]	buf			Buffer for the frames
+ * @param[in]	size		Size of @p buf in bytes, see DAC161S997_WAVE_BUF_SIZE()
+ */
+void dac161s997_wave_init(dac161s997_wave_t *wave, uint8_t *buf, size_t size);
+
+/**
+ * @brief	Appends a slew limited ramp.
+ *
+ * The output moves by at most @p slew_na per tick, from @p from_na up to and
+ * including @p to_na.
+ *
+ * @param[in]	dev			Device the waveform is for, its calibration is applied
+ * @param[in,out]	wave	Waveform to append to
+ * @param[in]	from_na		First sample in nA
+ * @param[in]	to_na		Last sample in nA
+ * @param[in]	slew_na		Max change per tick in nA, not 0
+ *
+ * @return		0			Ramp appended
+ * @return		-EINVAL		Value out of range
+ * @return		-ENOBUFS	Not enough room in the buffer, nothing appended
+ */
+int dac161s997_wave_ramp(dac161s997_dev_t *dev, dac161s997_wave_t *wave,
+                         int32_t from_na, int32_t to_na, uint32_t slew_na);
+
+/**
+ * @brief	Appends a sequence of steps.
+ *
+ * @param[in]	dev			Device the waveform is for, its calibration is applied
+ * @param[in,out]	wave	Waveform to append to
+ * @param[in]	levels_na	Level of each step in nA
+ * @param[in]	ticks		Number of ticks each level is held
+ * @param[in]	n			Number of steps
+ *
+ * @return		0			Steps appended
+ * @return		-EINVAL		Value out of range
+ * @return		-ENOBUFS	Not enough room in the buffer, nothing appended
+ */
+int dac161s997_wave_steps(dac161s997_dev_t *dev, dac161s997_wave_t *wave,
+                          const int32_t *levels_na, const uint32_t *ticks,
+                          size_t n);
+
+/**
+ * @brief	Appends arbitrary samples, one per tick.
+ *
+ * @param[in]	dev			Device the waveform is for, its calibration is applied
+ * @param[in,out]	wave	Waveform to append to
+ * @param[in]	samples_na	Samples in nA
+ * @param[in]	n			Number of samples
+ *
+ * @return		0			Samples appended
+ * @return		-EINVAL		Value out of range
+ * @return		-ENOBUFS	Not enough room in the buffer, nothing appended
+ */
+int dac161s997_wave_samples(dac161s997_dev_t *dev, dac161s997_wave_t *wave,
+                            const int32_t *samples_na, size_t n);
+
+/**
+ * @brief	Restarts streaming from the first sample.
+ *
+ * @param[in,out]	wave	Waveform to rewind
+ */
+void dac161s997_wave_rewind(dac161s997_wave_t *wave);
+
+/**
+ * @brief	Sends the next sample of a waveform.
+ *
+ * Meant to be called from a fixed rate tick. Apart from the first one, the
+ * echo of the previous sample is checked.
+ *
+ * @pre		Device must be initialized with dac161s997_init
+ *
+ * @param[in]	dev			Device to select
+ * @param[in,out]	wave	Waveform to stream
+ *
+ * @return		0			Sample sent
+ * @return		-ENOEXEC	The previous sample was not echoed back
+ * @return		-ENODATA	The waveform is done, rewind to play it again
+ * @return		errors from dac161s997_spi_xfer()
+ */
+int dac161s997_wave_tick(dac161s997_dev_t *dev, dac161s997_wave_t *wave);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DAC161S997_WAVE_H_ */
+/** @} */
@@ -27,24 +27,9 @@ extern "C" {
 /* Includes *******************************************************************/
 #include <stdint.h>
 #include <errno.h>
-#include "dac161s997_types.h"
+#include "dac161s997.h"
 
 /* Defines ********************************************************************/
-/**
- * @defgroup DAC161S997_REGS
- * @{
- */
-#define DAC161S997_XFR_REG                  0x01    /**< Command: transfer data into register (protected write mode) */
-#define DAC161S997_NOP_REG                  0x02    /**< Command: does nothing except resetting the timeout timer */
-#define DAC161S997_PROTECT_REG_WR_REG       0x03    /**< 1 means protected write mode in effect */
-#define DAC161S997_DACCODE_REG              0x04    /**< 16 bit DAC code to be written */
-#define DAC161S997_ERR_CONFIG_REG           0x05    /**< Configuration of error states */
-#define DAC161S997_ERR_LOW_REG              0x06    /**< DAC code for the <4mA alarm level */
-#define DAC161S997_ERR_HIGH_REG             0x07    /**< DAC code for the >20mA alarm level */
-#define DAC161S997_RESET_REG                0x08    /**< Command: reset the chip */
-#define DAC161S997_STATUS_REG               0x09    /**< Status of the chip */
-/** @} */
-
 /**
  * @defgroup DAC161S997_STATUS_REG
  * @{
@@ -54,6 +39,11 @@ extern "C" {
 #define DAC161S997_STATUS_REG_FERR_STS          0x0008  /**< Mask for frame errors */
 /** @} */
 
+#define DAC161S997_FRAME_SIZE           3   /**< Bytes of an SPI frame */
+
+#define DAC161S997_SHADOW_FIRST_REG     DAC161S997_PROTECT_REG_WR_REG   /**< First register kept in the context */
+#define DAC161S997_SHADOW_LAST_REG      DAC161S997_ERR_HIGH_REG         /**< Last register kept in the context */
+
 /* Function prototypes ********************************************************/
 /**
  * @brief    Reads register value from the dac161s997.
@@ -83,6 +73,168 @@ int dac161s997_read_reg(dac161s997_dev_t *dev, uint8_t addr,
 int dac161s997_write_reg(dac161s997_dev_t *dev, uint8_t addr,
                              uint16_t data);
 
+/**
+ * @brief    Sends a single frame that is already encoded.
+ *
+ * Keeps chip select high long enough since the previous frame.
+ *
+ * @param[in]   dev         Device to access
+ * @param[in]   tx_buf      DAC161S997_FRAME_SIZE bytes to send
+ * @param[out]  rx_buf      DAC161S997_FRAME_SIZE bytes received, the echo of
+ *                          the previous frame
+ *
+ * @return      0           No errors occurred
+ * @return      dac161s997_spi_xfer() defined errors
+ */
+int dac161s997_xfer_frame(dac161s997_dev_t *dev, uint8_t *tx_buf,
+                              uint8_t *rx_buf);
+
+/**
+ * @brief    Sends a single encoded frame to several devices.
+ *
+ * Uses dac161s997_spi_xfer_multi() if the port has it and can select the
+ * devices together, otherwise the frames go out back to back. The echo of
+ * the frame is checked by the next frame sent to each device. A broadcast
+ * loses the echo of the frame before, which must already be checked.
+ *
+ * @param[in]   devs        Devices to access
+ * @param[in]   n           Number of devices, up to 32
+ * @param[in]   tx_buf      DAC161S997_FRAME_SIZE bytes to send
+ * @param[out]  failed      Bit i set if the frame to device i failed
+ *
+ * @return      0           No errors occurred
+ * @return      dac161s997_spi_xfer() defined errors of the first failed device
+ */
+int dac161s997_xfer_frame_multi(dac161s997_dev_t *const *devs, size_t n,
+                                uint8_t *tx_buf, uint32_t *failed);
+
+/**
+ * @brief    Runs a batch of one op on each of several devices.
+ *
+ * Sends the op of every device, then the NOPs that clock out the echoes the
+ * verify policy of each device checks, each pass in one
+ * dac161s997_spi_xfer_each() call if the port has it. Mismatches are resent
+ * per device like in dac161s997_xfer_batch().
+ *
+ * @param[in]       devs        Devices to access
+ * @param[in, out]  ops         Op i for device i, results in the err fields
+ * @param[in]       n           Number of devices, up to 32
+ * @param[out]      failed      Bit i set if the op of device i failed
+ *
+ * @return      0           No errors occurred
+ * @return      dac161s997_xfer_batch() defined errors of the first failed
+ *              device
+ */
+int dac161s997_xfer_batch_each(dac161s997_dev_t *const *devs,
+                               dac161s997_op_t *ops, size_t n,
+                               uint32_t *failed);
+
+/**
+ * @brief    Reads a register, leaving the next read of it in flight.
+ *
+ * If the last frame sent to the device was already a read of @p addr its
+ * data comes back with the first frame, otherwise a second frame is needed.
+ * Either way the last frame asks for @p addr again, so back to back calls
+ * cost a single frame and return the value sampled by the previous call.
+ *
+ * @param[in]   dev         Device to read
+ * @param[in]   addr        Address to read, without DAC161S997_REG_READ
+ * @param[out]  data        Data that has been read
+ *
+ * @return      0           No errors occurred
+ * @return      -ENOTSUP    The device has no context
+ * @return      -ENOEXEC    The device did get expected values
+ * @return      dac161s997_spi_xfer() defined errors
+ */
+int dac161s997_read_pipelined(dac161s997_dev_t *dev, uint8_t addr,
+                              uint16_t *data);
+
+/**
+ * @brief    Encodes a command frame.
+ *
+ * @param[out]  buf         DAC161S997_FRAME_SIZE bytes to fill
+ * @param[in]   addr        Address, ORed with DAC161S997_REG_READ for reads
+ * @param[in]   data        Data of the frame
+ */
+void dac161s997_encode_frame(uint8_t *buf, uint8_t addr, uint16_t data);
+
+/**
+ * @brief    Updates the shadow and intended registers with the result of an op.
+ *
+ * @param[in]   ctx         Context of the device, may be NULL
+ * @param[in]   op          Finished op
+ */
+void dac161s997_shadow_update(dac161s997_ctx_t *ctx,
+                                  const dac161s997_op_t *op);
+
+/**
+ * @brief    Starts the ops queued in the context of a device asynchronously.
+ *
+ * Runs the same pipelined frames as dac161s997_xfer_batch() on the ops in
+ * dac161s997_ctx_t::async, one dac161s997_spi_xfer_async() per frame.
+ *
+ * @param[in]   dev         Device to access
+ * @param[in]   n           Number of ops queued in the context
+ * @param[in]   finish      Called with the first error once all frames are done
+ *
+ * @pre      The device has a context with no request in flight and the port
+ *           implements dac161s997_spi_xfer_async()
+ *
+ * @return      0           Frames started
+ * @return      dac161s997_spi_xfer_async() defined errors, every op is
+ *              marked failed as in dac161s997_xfer_batch()
+ */
+int dac161s997_xfer_batch_start(dac161s997_dev_t *dev, size_t n,
+                                    void (*finish)(dac161s997_dev_t *dev,
+                                                   int err));
+
+/**
+ * @brief    Applies the calibration of a device to a DAC code.
+ *
+ * @param[in]   dev         Device the code is for
+ * @param[in]   code        Ideal code of the wanted current
+ *
+ * @return      Code to send, unchanged if the device is not calibrated
+ */
+uint16_t dac161s997_cal_code(dac161s997_dev_t *dev, uint16_t code);
+
+/**
+ * @brief    Sends a bare NOP that checks the echo it clocks out.
+ *
+ * The echo is the previous frame sent to the device. It is only checked
+ * when the device has a context and the port a timestamp. If it does not
+ * match, or the previous frame is unknown, a second NOP checks the echo of
+ * the first one, so a healthy device passes whatever came before.
+ *
+ * @param[in]   dev         Device to keep alive
+ *
+ * @return      0           NOP sent, an echo matched or cannot be checked
+ * @return      -ENOEXEC    The NOP did not come back either
+ * @return      errors from dac161s997_xfer_batch()
+ */
+int dac161s997_keepalive_nop(dac161s997_dev_t *dev);
+
+/**
+ * @brief    Gets the context of a device if the port provides one.
+ *
+ * @param[in]   dev         Device to get the context of
+ *
+ * @return      Context of the device or NULL
+ */
+dac161s997_ctx_t *dac161s997_ctx(dac161s997_dev_t *dev);
+
+/**
+ * @brief    Gets the last known value of a register.
+ *
+ * @param[in]   ctx         Context of the device, may be NULL
+ * @param[in]   addr        Address of the register
+ * @param[out]  data        Last known value
+ *
+ * @return      1 if the value is known, 0 otherwise
+ */
+int dac161s997_shadow_get(const dac161s997_ctx_t *ctx, uint8_t addr,
+                              uint16_t *data);
+
 #ifdef __cplusplus
 }
 #endif
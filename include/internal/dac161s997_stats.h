@@ -0,0 +1,125 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/**
+ ******************************************************************************
+ * @addtogroup DRIVER_INTERNAL
+ * @{
+ * @file            dac161s997_stats.h
+ * @author          Kevin Weiss
+ * @brief           Instrumentation hooks of the dac161s997 driver
+ *
+ * With DAC161S997_STATS at 0 all hooks are empty inline functions, so the
+ * instrumented code compiles to the same as without it.
+ ******************************************************************************
+ */
+
+#ifndef DAC161S997_STATS_H_
+#define DAC161S997_STATS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include "dac161s997.h"
+
+/* Function prototypes ********************************************************/
+#if DAC161S997_STATS
+/**
+ * @brief    Counts frames that have been sent or failed.
+ *
+ * @param[in]   ctx         Context of the device, may be NULL
+ * @param[in]   err         Result of the port
+ * @param[in]   n           Number of frames
+ */
+void dac161s997_stats_frame(dac161s997_ctx_t *ctx, int err, size_t n);
+
+/**
+ * @brief    Counts an op whose echo did not match.
+ *
+ * @param[in]   ctx         Context of the device, may be NULL
+ */
+void dac161s997_stats_echo_error(dac161s997_ctx_t *ctx);
+
+/**
+ * @brief    Counts an op sent again after a failure.
+ *
+ * @param[in]   ctx         Context of the device, may be NULL
+ */
+void dac161s997_stats_retry(dac161s997_ctx_t *ctx);
+
+/**
+ * @brief    Counts a DACCODE write skipped as already set.
+ *
+ * @param[in]   ctx         Context of the device, may be NULL
+ */
+void dac161s997_stats_skipped_write(dac161s997_ctx_t *ctx);
+
+/**
+ * @brief    Gets the start time of a timed call.
+ *
+ * @return      Timestamp to give to dac161s997_stats_latency(), 0 if none
+ */
+uint64_t dac161s997_stats_start(void);
+
+/**
+ * @brief    Adds the latency of a call to its histogram.
+ *
+ * @param[in]   ctx         Context of the device, may be NULL
+ * @param[in]   op          One of @ref DAC161S997_STATS_OP
+ * @param[in]   start       Result of dac161s997_stats_start()
+ */
+void dac161s997_stats_latency(dac161s997_ctx_t *ctx, unsigned op,
+                              uint64_t start);
+#else
+static inline void dac161s997_stats_frame(dac161s997_ctx_t *ctx, int err,
+                                          size_t n)
+{
+    (void)ctx;
+    (void)err;
+    (void)n;
+}
+
+static inline void dac161s997_stats_echo_error(dac161s997_ctx_t *ctx)
+{
+    (void)ctx;
+}
+
+static inline void dac161s997_stats_retry(dac161s997_ctx_t *ctx)
+{
+    (void)ctx;
+}
+
+static inline void dac161s997_stats_skipped_write(dac161s997_ctx_t *ctx)
+{
+    (void)ctx;
+}
+
+static inline uint64_t dac161s997_stats_start(void)
+{
+    return 0;
+}
+
+static inline void dac161s997_stats_latency(dac161s997_ctx_t *ctx,
+                                            unsigned op, uint64_t start)
+{
+    (void)ctx;
+    (void)op;
+    (void)start;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DAC161S997_STATS_H_ */
+/** @} */
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/**
+ ******************************************************************************
+ * @addtogroup DRIVER_INTERNAL
+ * @{
+ * @file            dac161s997_trace_hooks.h
+ * @author          Kevin Weiss
+ * @brief           Recording hooks of the dac161s997 driver
+ *
+ * The hooks are inline so a device without a trace only costs a test of
+ * its context.
+ ******************************************************************************
+ */
+
+#ifndef DAC161S997_TRACE_HOOKS_H_
+#define DAC161S997_TRACE_HOOKS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include "dac161s997.h"
+#include "dac161s997_trace.h"
+
+/* Function prototypes ********************************************************/
+/**
+ * @brief    Appends the start of a driver call to the trace of a device.
+ *
+ * @param[in]   ctx         Context of the device with a trace
+ * @param[in]   call        Kind of call
+ * @param[in]   n           Number of ops of the call
+ */
+void dac161s997_trace_put_call(dac161s997_ctx_t *ctx,
+                               DAC161S997_TRACE_CALL_t call, size_t n);
+
+/**
+ * @brief    Appends frames to the trace of a device.
+ *
+ * @param[in]   ctx         Context of the device with a trace
+ * @param[in]   tx_buf      Frames sent
+ * @param[in]   rx_buf      Frames received
+ * @param[in]   n           Number of frames
+ * @param[in]   err         Result of the port
+ * @param[in]   ts_ns       End of the frames, 0 if unknown
+ */
+void dac161s997_trace_put_frames(dac161s997_ctx_t *ctx, const uint8_t *tx_buf,
+                                 const uint8_t *rx_buf, size_t n, int err,
+                                 uint64_t ts_ns);
+
+/**
+ * @brief    Records the start of a driver call if the device is traced.
+ *
+ * @param[in]   ctx         Context of the device, may be NULL
+ * @param[in]   call        Kind of call
+ * @param[in]   n           Number of ops of the call
+ */
+static inline void dac161s997_trace_call(dac161s997_ctx_t *ctx,
+                                         DAC161S997_TRACE_CALL_t call,
+                                         size_t n)
+{
+    if (ctx && ctx->trace) {
+        dac161s997_trace_put_call(ctx, call, n);
+    }
+}
+
+/**
+ * @brief    Records frames if the device is traced.
+ *
+ * @param[in]   ctx         Context of the device, may be NULL
+ * @param[in]   tx_buf      Frames sent
+ * @param[in]   rx_buf      Frames received
+ * @param[in]   n           Number of frames
+ * @param[in]   err         Result of the port
+ * @param[in]   ts_ns       End of the frames, 0 if unknown
+ */
+static inline void dac161s997_trace_frames(dac161s997_ctx_t *ctx,
+                                           const uint8_t *tx_buf,
+                                           const uint8_t *rx_buf, size_t n,
+                                           int err, uint64_t ts_ns)
+{
+    if (ctx && ctx->trace) {
+        dac161s997_trace_put_frames(ctx, tx_buf, rx_buf, n, err, ts_ns);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DAC161S997_TRACE_HOOKS_H_ */
+/** @} */
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#include "dac161s997_port.h"
+#include "dac161s997_spidev.h"
+
+/* Private functions **********************************************************/
+static int _ioctl(dac161s997_spidev_t *spi, unsigned long request, void *arg);
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+int dac161s997_spidev_open(dac161s997_spidev_t *spi, const char *path,
+                           uint8_t mode, uint32_t speed_hz)
+{
+    int err;
+
+    spi->fd = open(path, O_RDWR | O_CLOEXEC);
+    if (spi->fd < 0) {
+        return -errno;
+    }
+    spi->speed_hz = speed_hz;
+    spi->ioctl = NULL;
+
+    err = dac161s997_spidev_setup(spi, mode);
+    if (err) {
+        dac161s997_spidev_close(spi);
+    }
+    return err;
+}
+
+int dac161s997_spidev_setup(dac161s997_spidev_t *spi, uint8_t mode)
+{
+    uint8_t bits = 8;
+    uint32_t speed_hz = spi->speed_hz;
+
+    if (_ioctl(spi, SPI_IOC_WR_MODE, &mode) < 0 ||
+        _ioctl(spi, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+        _ioctl(spi, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+void dac161s997_spidev_close(dac161s997_spidev_t *spi)
+{
+    if (spi->fd >= 0) {
+        close(spi->fd);
+        spi->fd = -1;
+    }
+}
+
+int dac161s997_spidev_xfer(dac161s997_spidev_t *spi, uint8_t *tx_buf,
+                           uint8_t *rx_buf, size_t size)
+{
+    const dac161s997_spi_seg_t seg = {
+        .tx_buf = tx_buf, .rx_buf = rx_buf, .size = size, .cs_change = 1
+    };
+
+    return dac161s997_spidev_xfer_vec(spi, &seg, 1);
+}
+
+int dac161s997_spidev_xfer_vec(dac161s997_spidev_t *spi,
+                               const dac161s997_spi_seg_t *segs, size_t n)
+{
+    struct spi_ioc_transfer tr[DAC161S997_SPIDEV_MAX_SEGS];
+
+    for (size_t base = 0; base < n; base += DAC161S997_SPIDEV_MAX_SEGS) {
+        size_t count = n - base;
+
+        if (count > DAC161S997_SPIDEV_MAX_SEGS) {
+            count = DAC161S997_SPIDEV_MAX_SEGS;
+        }
+        memset(tr, 0, count * sizeof(tr[0]));
+        for (size_t i = 0; i < count; i++) {
+            const dac161s997_spi_seg_t *seg = &segs[base + i];
+
+            tr[i].tx_buf = (uintptr_t)seg->tx_buf;
+            tr[i].rx_buf = (uintptr_t)seg->rx_buf;
+            tr[i].len = (uint32_t)seg->size;
+            tr[i].speed_hz = spi->speed_hz;
+            tr[i].bits_per_word = 8;
+            tr[i].cs_change = seg->cs_change;
+        }
+        /*
+         * spidev always releases chip select at the end of a message and
+         * cs_change on its last transfer means the opposite, keep it low
+         */
+        tr[count - 1].cs_change = (base + count < n) &&
+                                  !segs[base + count - 1].cs_change;
+        if (_ioctl(spi, SPI_IOC_MESSAGE(count), tr) < 0) {
+            return -errno;
+        }
+    }
+    return 0;
+}
+
+static int _ioctl(dac161s997_spidev_t *spi, unsigned long request, void *arg)
+{
+    if (spi->ioctl) {
+        return spi->ioctl(spi->fd, request, arg);
+    }
+    return ioctl(spi->fd, request, arg);
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ */
+
+/**
+ ******************************************************************************
+ * @addtogroup PORTABLE
+ * @{
+ * @file			dac161s997_spidev.h
+ * @brief			Linux spidev backend of the dac161s997 port
+ *
+ * Implements the scalar and vectored SPI transfers on a spidev character
+ * device. A vector of frames goes out as a single SPI_IOC_MESSAGE() with
+ * cs_change set between them, one syscall instead of one per frame.
+ *
+ * The user defined dac161s997_dev_t holds a dac161s997_spidev_t and the port
+ * forwards to it:
+ * @code
+ * int dac161s997_spi_xfer_vec(dac161s997_dev_t *dev,
+ *                             const dac161s997_spi_seg_t *segs, size_t n)
+ * {
+ *     return dac161s997_spidev_xfer_vec(&dev->spi, segs, n);
+ * }
+ * @endcode
+ * The ioctl can be replaced, for example by a stand-in device for testing.
+ ******************************************************************************
+ */
+
+#ifndef DAC161S997_SPIDEV_H_
+#define DAC161S997_SPIDEV_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include "dac161s997_port.h"
+
+/* Defines ********************************************************************/
+#ifndef DAC161S997_SPIDEV_MAX_SEGS
+#define DAC161S997_SPIDEV_MAX_SEGS      16  /**< Transfers per SPI_IOC_MESSAGE() */
+#endif
+
+/* Typedefs *******************************************************************/
+/** ioctl() compatible function the backend goes through */
+typedef int (*dac161s997_spidev_ioctl_t)(int fd, unsigned long request,
+                                         void *arg);
+
+typedef struct {
+    int fd;                 /**< Open spidev device */
+    uint32_t speed_hz;      /**< SCLK frequency */
+    dac161s997_spidev_ioctl_t ioctl;    /**< NULL for the system ioctl() */
+} dac161s997_spidev_t;      /**< A spidev chip select */
+
+/* Function prototypes ********************************************************/
+/**
+ * @brief	Opens and sets up a spidev device.
+ *
+ * @param[out]	spi			Backend to set up
+ * @param[in]	path		Device, for example "/dev/spidev0.0"
+ * @param[in]	mode		SPI mode, SPI_MODE_0 to SPI_MODE_3
+ * @param[in]	speed_hz	SCLK frequency
+ *
+ * @return		0			Device ready
+ * @return		negative errno of open() or ioctl()
+ */
+int dac161s997_spidev_open(dac161s997_spidev_t *spi, const char *path,
+                           uint8_t mode, uint32_t speed_hz);
+
+/**
+ * @brief	Sets up an already open spidev device.
+ *
+ * dac161s997_spidev_t::fd, dac161s997_spidev_t::speed_hz and
+ * dac161s997_spidev_t::ioctl must be filled in.
+ *
+ * @param[in]	spi			Backend to set up
+ * @param[in]	mode		SPI mode, SPI_MODE_0 to SPI_MODE_3
+ *
+ * @return		0			Device ready
+ * @return		negative errno of ioctl()
+ */
+int dac161s997_spidev_setup(dac161s997_spidev_t *spi, uint8_t mode);
+
+/**
+ * @brief	Closes a spidev device.
+ *
+ * @param[in]	spi			Backend to close
+ */
+void dac161s997_spidev_close(dac161s997_spidev_t *spi);
+
+/**
+ * @brief	Backend of dac161s997_spi_xfer().
+ *
+ * @param[in]	spi			Backend to use
+ * @param[in]	tx_buf		Bytes to send on MOSI
+ * @param[out]	rx_buf		Bytes read from MISO
+ * @param[in]	size		Number of bytes to xfer
+ *
+ * @return		0			Transfer done
+ * @return		negative errno of ioctl()
+ */
+int dac161s997_spidev_xfer(dac161s997_spidev_t *spi, uint8_t *tx_buf,
+                           uint8_t *rx_buf, size_t size);
+
+/**
+ * @brief	Backend of dac161s997_spi_xfer_vec().
+ *
+ * Up to DAC161S997_SPIDEV_MAX_SEGS segments go out per syscall. The kernel
+ * keeps chip select high between transfers for its cs_change delay, 10 us
+ * unless the controller driver sets another one.
+ *
+ * @param[in]	spi			Backend to use
+ * @param[in]	segs		Segments to clock
+ * @param[in]	n			Number of segments
+ *
+ * @return		0			Transfer done
+ * @return		negative errno of ioctl()
+ */
+int dac161s997_spidev_xfer_vec(dac161s997_spidev_t *spi,
+                               const dac161s997_spi_seg_t *segs, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DAC161S997_SPIDEV_H_ */
+/** @} */
@@ -11,148 +11,927 @@
 #include "dac161s997.h"
 #include "dac161s997_port.h"
 #include "internal/dac161s997_regs.h"
+#include "internal/dac161s997_stats.h"
 
 /* Private macros *************************************************************/
-/* maybe can use some more precision but uint32_t overflow could be an issue */
-#define _NA_TO_DAC_TICKS(val)   (val / 366)
+#define ARRAY_SIZE(a)           (sizeof(a) / sizeof((a)[0]))
 
 /* Private definitions ********************************************************/
 #define _DAC_CHIP_RESET_CODE            0xC33C
+#define _DAC_XFR_CODE                   0x00FF
 #define _NOT_PROTECTED                  0
 #define _PROTECTED                      1
 
-/* Error levels as per NAMUR NE43 *********************************************/
-#define DAC161S997_UNINIT_ALARM_NA  ((uint32_t)3300000)  /**< Uninitialized value in nA */
-#define DAC161S997_FAIL_LO_ALARM_NA ((uint32_t)3600000)  /**< Lo error value in nA */
-#define DAC161S997_SAT_LO_ALARM_NA  ((uint32_t)3800000)  /**< Lo saturation value in nA */
-#define DAC161S997_SAT_HI_ALARM_NA  ((uint32_t)20500000) /**< Hi saturation value in nA */
-#define DAC161S997_FAIL_HI_ALARM_NA ((uint32_t)21000000) /**< Hi error value in nA */
+/* DAC codes of the error levels */
+#define _FAIL_LO_ALARM_CODE     DAC161S997_NA_TO_CODE(DAC161S997_FAIL_LO_ALARM_NA)
+#define _SAT_LO_ALARM_CODE      DAC161S997_NA_TO_CODE(DAC161S997_SAT_LO_ALARM_NA)
+#define _SAT_HI_ALARM_CODE      DAC161S997_NA_TO_CODE(DAC161S997_SAT_HI_ALARM_NA)
+#define _FAIL_HI_ALARM_CODE     DAC161S997_NA_TO_CODE(DAC161S997_FAIL_HI_ALARM_NA)
 
-#define _ERR_CONFIG_SPI_TIMOUT_400MS    (7 << 1)
+/* Keep the DACCODE found by _sync() if the configuration matches */
+#define _SYNC_ADOPT                     UINT32_MAX
+
+/* Status bits after which a self healing device recovers */
+#define _HEAL_STATUS    (DAC161S997_STATUS_COM_TIMEOUT | \
+                         DAC161S997_STATUS_FRAME_ERR | \
+                         DAC161S997_STATUS_MISMATCH)
+
+/* Private functions **********************************************************/
+static size_t _init_ops(dac161s997_dev_t *dev, dac161s997_op_t *ops);
+
+static int _init_result(const dac161s997_op_t *ops, int err);
+
+static int _sync(dac161s997_dev_t *dev, const dac161s997_op_t *want,
+                 uint32_t code);
+
+static int _heal(dac161s997_dev_t *dev, int err, uint32_t *status);
+
+static int _alarm_code(dac161s997_dev_t *dev, DAC161S997_ALARM_t alarm,
+                       uint16_t *code);
+
+static void _check_outputs(const int32_t *n_amps, size_t n, uint32_t *err_map);
+
+static int _stage_daccode(dac161s997_dev_t *dev, uint16_t code);
+
+static int _staged(dac161s997_dev_t *dev);
+
+static void _lost_daccode(dac161s997_dev_t *dev);
+
+static size_t _daccode_ops(dac161s997_dev_t *dev, uint16_t code,
+                           dac161s997_op_t *ops);
+
+static int _write_daccode(dac161s997_dev_t *dev, uint16_t code);
+
+static int _keepalive(dac161s997_dev_t *dev);
+
+static size_t _status_ops(dac161s997_dev_t *dev, dac161s997_op_t *ops);
+
+static int _status_decode(dac161s997_dev_t *dev, const dac161s997_op_t *ops,
+                          size_t n, uint32_t *status);
+
+static uint32_t _status_bits(uint16_t data);
+
+static uint32_t _alarm_bits(uint16_t code, uint16_t alarm_lo,
+                            uint16_t alarm_hi);
+
+static int _audit_due(dac161s997_ctx_t *ctx);
+
+static int _async_ctx(dac161s997_dev_t *dev, dac161s997_ctx_t **ctx);
+
+static void _async_finish(dac161s997_dev_t *dev, int err);
+
+static void _async_finish_init(dac161s997_dev_t *dev, int err);
+
+static void _async_finish_status(dac161s997_dev_t *dev, int err);
 
 /******************************************************************************/
 /* Functions                                                                  */
 /******************************************************************************/
 int dac161s997_init(dac161s997_dev_t *dev)
 {
-    int err = 0;
+    int err;
+    uint64_t start = dac161s997_stats_start();
+    dac161s997_op_t ops[DAC161S997_ASYNC_MAX_OPS];
+    size_t n = _init_ops(dev, ops);
+
+    err = _init_result(ops, dac161s997_xfer_batch(dev, ops, n));
+    dac161s997_stats_latency(dac161s997_ctx(dev), DAC161S997_STATS_OP_INIT,
+                             start);
+    return err;
+}
+
+int dac161s997_init_warm(dac161s997_dev_t *dev)
+{
+    int err;
+    uint64_t start = dac161s997_stats_start();
+    dac161s997_op_t init[DAC161S997_ASYNC_MAX_OPS];
+
+    _init_ops(dev, init);
+    err = _sync(dev, &init[1], _SYNC_ADOPT);
+    if (err == -EIO || err == -ENOEXEC) {
+        err = dac161s997_init(dev);
+    }
+    dac161s997_stats_latency(dac161s997_ctx(dev), DAC161S997_STATS_OP_INIT,
+                             start);
+    return err;
+}
+
+int dac161s997_recover(dac161s997_dev_t *dev)
+{
+    int err;
+    size_t n = 0;
+    uint16_t intent[5];
+    uint8_t valid;
+    uint32_t code = _SYNC_ADOPT;
+    uint64_t start = dac161s997_stats_start();
+    dac161s997_op_t init[DAC161S997_ASYNC_MAX_OPS];
+    dac161s997_op_t want[DAC161S997_ASYNC_MAX_OPS];
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+    const size_t n_init = _init_ops(dev, init);
+
+    if (!ctx) {
+        return dac161s997_init(dev);
+    }
+    /* Registers never written since the reset are expected at their init
+     * values, a reset clears the record so keep a copy for the restore
+     */
+    memcpy(intent, ctx->intent, sizeof(intent));
+    valid = ctx->intent_valid;
+    memcpy(want, init, n_init * sizeof(want[0]));
+    for (size_t i = 1; i < n_init; i++) {
+        uint8_t idx = want[i].addr - DAC161S997_SHADOW_FIRST_REG;
+
+        if (valid & (1 << idx)) {
+            want[i].data = intent[idx];
+        }
+    }
+    if (valid & (1 << (DAC161S997_DACCODE_REG - DAC161S997_SHADOW_FIRST_REG))) {
+        code = want[n_init - 1].data;
+    }
+
+    err = _sync(dev, &want[1], code);
+    if (err == -EIO || err == -ENOEXEC) {
+        /* The read back cannot be trusted, reset and restore everything */
+        err = dac161s997_init(dev);
+        for (size_t i = 1; !err && i < n_init; i++) {
+            if (want[i].data != init[i].data) {
+                want[n++] = want[i];
+            }
+        }
+        if (!err && n) {
+            err = dac161s997_xfer_batch(dev, want, n);
+        }
+    }
+    if (!err) {
+        ctx->audit.suspect = 0;
+    }
+    dac161s997_stats_latency(ctx, DAC161S997_STATS_OP_INIT, start);
+    return err;
+}
+
+int dac161s997_set_self_heal(dac161s997_dev_t *dev, int enable)
+{
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    if (!ctx) {
+        return -ENOTSUP;
+    }
+    ctx->audit.heal = (enable != 0);
+    return 0;
+}
+
+int dac161s997_set_output(dac161s997_dev_t *dev, int32_t n_amps)
+{
+    int err;
+    uint64_t start = dac161s997_stats_start();
+
+    if (!dac161s997_na_valid(n_amps)) {
+        return -EINVAL;
+    }
+    err = _write_daccode(dev, dac161s997_cal_code(dev,
+                                                  dac161s997_na_to_code(n_amps)));
+    dac161s997_stats_latency(dac161s997_ctx(dev),
+                             DAC161S997_STATS_OP_SET_OUTPUT, start);
+    return err;
+}
+
+int dac161s997_set_code(dac161s997_dev_t *dev, uint16_t code)
+{
+    int err;
+    uint64_t start = dac161s997_stats_start();
+
+    err = _write_daccode(dev, dac161s997_cal_code(dev, code));
+    dac161s997_stats_latency(dac161s997_ctx(dev),
+                             DAC161S997_STATS_OP_SET_OUTPUT, start);
+    return err;
+}
+
+int dac161s997_set_outputs(dac161s997_dev_t *const *devs,
+                           const int32_t *n_amps, size_t n,
+                           uint32_t *err_map)
+{
+    int err;
+    int first_err = 0;
+    uint16_t codes[32];
+    uint8_t idx[32];
+    dac161s997_op_t ops[32];
+    dac161s997_dev_t *group[32];
+
+    /* Validate everything before the first frame goes out */
+    _check_outputs(n_amps, n, err_map);
+
+    /* Convert and dispatch one error map word worth of channels at a time */
+    for (size_t base = 0; base < n; base += 32) {
+        size_t count = (n - base < 32) ? n - base : 32;
+        size_t writes = 0;
+        uint32_t *failed = &err_map[base / 32];
+        uint32_t range_map;
+        uint32_t lost;
 
-    err =
-        dac161s997_write_reg(dev, DAC161S997_RESET_REG, _DAC_CHIP_RESET_CODE);
+        /* Already validated, only the codes are used */
+        dac161s997_na_to_codes(&n_amps[base], codes, count, &range_map);
+        for (size_t i = 0; i < count; i++) {
+            codes[i] = dac161s997_cal_code(devs[base + i], codes[i]);
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (*failed & ((uint32_t)1 << i)) {
+                err = -EINVAL;
+            }
+            else if (_daccode_ops(devs[base + i], codes[i], &ops[writes])) {
+                group[writes] = devs[base + i];
+                idx[writes++] = i;
+                continue;
+            }
+            else {
+                err = _keepalive(devs[base + i]);
+            }
+            if (err) {
+                *failed |= (uint32_t)1 << i;
+                if (!first_err) {
+                    first_err = err;
+                }
+            }
+        }
+        /* The changed channels go out together, then their verify NOPs */
+        err = dac161s997_xfer_batch_each(group, ops, writes, &lost);
+        for (size_t k = 0; k < writes; k++) {
+            if (lost & ((uint32_t)1 << k)) {
+                *failed |= (uint32_t)1 << idx[k];
+            }
+        }
+        if (err && !first_err) {
+            first_err = err;
+        }
+    }
+    return first_err;
+}
+
+int dac161s997_set_outputs_sync(dac161s997_dev_t *const *devs,
+                                const int32_t *n_amps, size_t n,
+                                uint32_t *err_map)
+{
+    int err;
+    int first_err = 0;
+    uint32_t failed;
+    uint8_t xfr[DAC161S997_FRAME_SIZE];
+    uint8_t idx[32];
+    dac161s997_dev_t *group[32];
+
+    _check_outputs(n_amps, n, err_map);
+
+    /* Stage every channel first, no output moves until the commit */
+    for (size_t i = 0; i < n; i++) {
+        uint16_t code;
+
+        if (err_map[i / 32] & ((uint32_t)1 << (i % 32))) {
+            err = -EINVAL;
+        }
+        else {
+            code = dac161s997_cal_code(devs[i],
+                                       dac161s997_na_to_code(n_amps[i]));
+            err = _stage_daccode(devs[i], code);
+        }
+        if (err) {
+            err_map[i / 32] |= (uint32_t)1 << (i % 32);
+            if (!first_err) {
+                first_err = err;
+            }
+        }
+    }
+
+    /* Commit back to back, nothing else goes on the bus in between */
+    dac161s997_encode_frame(xfr, DAC161S997_XFR_REG, _DAC_XFR_CODE);
+    for (size_t base = 0; base < n; base += 32) {
+        size_t count = 0;
+        uint32_t *word = &err_map[base / 32];
+
+        for (size_t i = 0; i < 32 && base + i < n; i++) {
+            if (!(*word & ((uint32_t)1 << i)) && _staged(devs[base + i])) {
+                idx[count] = (uint8_t)i;
+                group[count++] = devs[base + i];
+            }
+        }
+        err = dac161s997_xfer_frame_multi(group, count, xfr, &failed);
+        if (err && !first_err) {
+            first_err = err;
+        }
+        for (size_t k = 0; k < count; k++) {
+            if (failed & ((uint32_t)1 << k)) {
+                *word |= (uint32_t)1 << idx[k];
+                _lost_daccode(group[k]);
+            }
+        }
+    }
+
+    /* Back to direct writes, also after a failure so later writes are not
+     * held. The first frame checks the echo of the XFR.
+     */
+    for (size_t i = 0; i < n; i++) {
+        dac161s997_op_t op = DAC161S997_OP_WRITE(DAC161S997_PROTECT_REG_WR_REG,
+                                                 _NOT_PROTECTED);
+
+        if (!dac161s997_na_valid(n_amps[i]) ||
+            !_staged(devs[i])) {
+            continue;
+        }
+        err = dac161s997_xfer_batch(devs[i], &op, 1);
+        if (err) {
+            _lost_daccode(devs[i]);
+            err_map[i / 32] |= (uint32_t)1 << (i % 32);
+            if (!first_err) {
+                first_err = err;
+            }
+        }
+    }
+    return first_err;
+}
+
+int dac161s997_set_alarm(dac161s997_dev_t *dev, DAC161S997_ALARM_t alarm)
+{
+    int err;
+    uint16_t code;
+    uint64_t start = dac161s997_stats_start();
+
+    if (_alarm_code(dev, alarm, &code)) {
+        return -EINVAL;
+    }
+    err = _write_daccode(dev, code);
+    dac161s997_stats_latency(dac161s997_ctx(dev),
+                             DAC161S997_STATS_OP_SET_ALARM, start);
+    return err;
+}
+
+int dac161s997_get_status(dac161s997_dev_t *dev, uint32_t *status)
+{
+    int err;
+    int batch_err;
+    uint64_t start = dac161s997_stats_start();
+    dac161s997_op_t ops[4];
+    size_t n = _status_ops(dev, ops);
+
+    batch_err = dac161s997_xfer_batch(dev, ops, n);
+    err = _status_decode(dev, ops, n, status);
+    dac161s997_stats_latency(dac161s997_ctx(dev),
+                             DAC161S997_STATS_OP_GET_STATUS, start);
+    err = _heal(dev, err, status);
+    /* Reads that decode fine leave only a lazily verified write to report */
+    return err ? err : batch_err;
+}
+
+int dac161s997_get_status_fast(dac161s997_dev_t *dev, uint32_t *status)
+{
+    int err;
+    uint16_t data;
+    uint16_t code = 0;
+    uint16_t alarm_lo = 0;
+    uint16_t alarm_hi = 0;
+    uint64_t start;
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    if (!ctx) {
+        return dac161s997_get_status(dev, status);
+    }
+    if (_audit_due(ctx)) {
+        return dac161s997_audit(dev, status);
+    }
+
+    start = dac161s997_stats_start();
+    *status = 0;
+    err = dac161s997_read_pipelined(dev, DAC161S997_STATUS_REG, &data);
     if (err == -ENOEXEC) {
-        return -ENXIO;
+        *status |= DAC161S997_STATUS_ABSENT;
+    }
+    if (!err) {
+        dac161s997_shadow_get(ctx, DAC161S997_DACCODE_REG, &code);
+        dac161s997_shadow_get(ctx, DAC161S997_ERR_LOW_REG, &alarm_lo);
+        dac161s997_shadow_get(ctx, DAC161S997_ERR_HIGH_REG, &alarm_hi);
+        *status |= _status_bits(data) | _alarm_bits(code, alarm_lo, alarm_hi);
+    }
+    /* A bad echo, a garbled frame or a timeout may have touched registers */
+    ctx->audit.suspect = err || (*status & (DAC161S997_STATUS_COM_TIMEOUT |
+                                            DAC161S997_STATUS_FRAME_ERR));
+    dac161s997_stats_latency(ctx, DAC161S997_STATS_OP_GET_STATUS, start);
+    return _heal(dev, err, status);
+}
+
+int dac161s997_audit(dac161s997_dev_t *dev, uint32_t *status)
+{
+    int err;
+    int batch_err;
+    uint16_t known[6];
+    uint8_t valid = 0;
+    uint64_t start = dac161s997_stats_start();
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+    /* Same order as _status_ops() so the status decodes the same way */
+    dac161s997_op_t ops[] = {
+        DAC161S997_OP_READ(DAC161S997_STATUS_REG),
+        DAC161S997_OP_READ(DAC161S997_DACCODE_REG),
+        DAC161S997_OP_READ(DAC161S997_ERR_LOW_REG),
+        DAC161S997_OP_READ(DAC161S997_ERR_HIGH_REG),
+        DAC161S997_OP_READ(DAC161S997_PROTECT_REG_WR_REG),
+        DAC161S997_OP_READ(DAC161S997_ERR_CONFIG_REG),
+    };
+
+    /* Reads update the shadow, so keep what the driver expects first */
+    for (size_t i = 1; i < ARRAY_SIZE(ops); i++) {
+        if (dac161s997_shadow_get(ctx, ops[i].addr & ~DAC161S997_REG_READ,
+                                  &known[i])) {
+            valid |= 1 << i;
+        }
+    }
+    batch_err = dac161s997_xfer_batch(dev, ops, ARRAY_SIZE(ops));
+    err = _status_decode(dev, ops, 4, status);
+    for (size_t i = 1; !err && i < ARRAY_SIZE(ops); i++) {
+        err = ops[i].err;
+        if (!err && (valid & (1 << i)) && ops[i].data != known[i]) {
+            *status |= DAC161S997_STATUS_MISMATCH;
+        }
+    }
+    if (ctx) {
+        ctx->audit.count = 0;
+        ctx->audit.suspect = (err != 0);
+    }
+    dac161s997_stats_latency(ctx, DAC161S997_STATS_OP_GET_STATUS, start);
+    err = _heal(dev, err, status);
+    return err ? err : batch_err;
+}
+
+int dac161s997_set_audit(dac161s997_dev_t *dev, uint16_t every)
+{
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    if (!ctx) {
+        return -ENOTSUP;
     }
+    ctx->audit.every = every;
+    ctx->audit.count = 0;
+    return 0;
+}
+
+int dac161s997_init_start(dac161s997_dev_t *dev, dac161s997_cb_t cb,
+                          void *arg)
+{
+    int err;
+    dac161s997_ctx_t *ctx;
+
+    err = _async_ctx(dev, &ctx);
     if (err) {
         return err;
     }
+    ctx->async.cb = cb;
+    ctx->async.arg = arg;
+    return dac161s997_xfer_batch_start(dev, _init_ops(dev, ctx->async.ops),
+                                       _async_finish_init);
+}
+
+int dac161s997_set_output_start(dac161s997_dev_t *dev, int32_t n_amps,
+                                dac161s997_cb_t cb, void *arg)
+{
+    if (!dac161s997_na_valid(n_amps)) {
+        return -EINVAL;
+    }
+    return dac161s997_set_code_start(dev, dac161s997_na_to_code(n_amps), cb,
+                                     arg);
+}
 
-    /* We should not worry about protecting as we can catch errors and it
-     * shouldn't be sharing communication with other devices.
-     */
-    err = dac161s997_write_reg(dev, DAC161S997_PROTECT_REG_WR_REG,
-                               _NOT_PROTECTED);
+int dac161s997_set_code_start(dac161s997_dev_t *dev, uint16_t code,
+                              dac161s997_cb_t cb, void *arg)
+{
+    int err;
+    dac161s997_ctx_t *ctx;
+
+    err = _async_ctx(dev, &ctx);
     if (err) {
         return err;
     }
+    ctx->async.cb = cb;
+    ctx->async.arg = arg;
+    code = dac161s997_cal_code(dev, code);
+    return dac161s997_xfer_batch_start(dev,
+                                       _daccode_ops(dev, code,
+                                                    ctx->async.ops),
+                                       _async_finish);
+}
+
+int dac161s997_set_alarm_start(dac161s997_dev_t *dev,
+                               DAC161S997_ALARM_t alarm,
+                               dac161s997_cb_t cb, void *arg)
+{
+    int err;
+    uint16_t code;
+    dac161s997_ctx_t *ctx;
 
-    err = dac161s997_write_reg(dev, DAC161S997_ERR_CONFIG_REG,
-                               _ERR_CONFIG_SPI_TIMOUT_400MS);
+    if (_alarm_code(dev, alarm, &code)) {
+        return -EINVAL;
+    }
+    err = _async_ctx(dev, &ctx);
     if (err) {
         return err;
     }
+    ctx->async.cb = cb;
+    ctx->async.arg = arg;
+    return dac161s997_xfer_batch_start(dev,
+                                       _daccode_ops(dev, code,
+                                                    ctx->async.ops),
+                                       _async_finish);
+}
 
-    err =
-        dac161s997_write_reg(dev, DAC161S997_ERR_LOW_REG, _NA_TO_DAC_TICKS(
-                                 DAC161S997_FAIL_LO_ALARM_NA));
+int dac161s997_get_status_start(dac161s997_dev_t *dev, uint32_t *status,
+                                dac161s997_cb_t cb, void *arg)
+{
+    int err;
+    dac161s997_ctx_t *ctx;
+
+    err = _async_ctx(dev, &ctx);
     if (err) {
         return err;
     }
+    ctx->async.cb = cb;
+    ctx->async.arg = arg;
+    ctx->async.status = status;
+    return dac161s997_xfer_batch_start(dev, _status_ops(dev, ctx->async.ops),
+                                       _async_finish_status);
+}
+
+int dac161s997_async_result(dac161s997_dev_t *dev)
+{
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    if (!ctx) {
+        return -ENOTSUP;
+    }
+    if (!ctx->async.finish) {
+        /* Zero initialized context, no request was ever started */
+        return -ENODATA;
+    }
+    return ctx->async.result;
+}
+
+static size_t _init_ops(dac161s997_dev_t *dev, dac161s997_op_t *ops)
+{
+    /* We should not worry about protecting as we can catch errors and it
+     * shouldn't be sharing communication with other devices.
+     */
+    const dac161s997_op_t init_ops[] = {
+        DAC161S997_OP_WRITE(DAC161S997_RESET_REG, _DAC_CHIP_RESET_CODE),
+        DAC161S997_OP_WRITE(DAC161S997_PROTECT_REG_WR_REG, _NOT_PROTECTED),
+        DAC161S997_OP_WRITE(DAC161S997_ERR_CONFIG_REG,
+                            DAC161S997_INIT_ERR_CONFIG),
+        DAC161S997_OP_WRITE(DAC161S997_ERR_LOW_REG,
+                            dac161s997_cal_code(dev, _FAIL_LO_ALARM_CODE)),
+        DAC161S997_OP_WRITE(DAC161S997_ERR_HIGH_REG,
+                            dac161s997_cal_code(dev, _FAIL_HI_ALARM_CODE)),
+        DAC161S997_OP_WRITE(DAC161S997_DACCODE_REG,
+                            dac161s997_cal_code(dev, _FAIL_LO_ALARM_CODE)),
+    };
+
+    memcpy(ops, init_ops, sizeof(init_ops));
+    return ARRAY_SIZE(init_ops);
+}
+
+static int _init_result(const dac161s997_op_t *ops, int err)
+{
+    if (ops[0].err == -ENOEXEC) {
+        return -ENXIO;
+    }
+    return err;
+}
+
+/* Reads back the configuration and rewrites what differs from want, the
+ * writes of _init_ops() without the reset. DACCODE is set to code or, with
+ * _SYNC_ADOPT, kept when nothing else differs and set to the DACCODE of want
+ * otherwise. Returns -EIO if the values read back cannot come from a chip
+ * that was configured by this driver.
+ */
+static int _sync(dac161s997_dev_t *dev, const dac161s997_op_t *want,
+                 uint32_t code)
+{
+    int err;
+    size_t n = 0;
+    uint8_t config_ok = 1;
+    dac161s997_op_t writes[DAC161S997_ASYNC_MAX_OPS];
+    /* Same order as _init_ops() without the reset */
+    dac161s997_op_t ops[] = {
+        DAC161S997_OP_READ(DAC161S997_PROTECT_REG_WR_REG),
+        DAC161S997_OP_READ(DAC161S997_ERR_CONFIG_REG),
+        DAC161S997_OP_READ(DAC161S997_ERR_LOW_REG),
+        DAC161S997_OP_READ(DAC161S997_ERR_HIGH_REG),
+        DAC161S997_OP_READ(DAC161S997_DACCODE_REG),
+    };
+    const size_t daccode = ARRAY_SIZE(ops) - 1;
 
-    err =
-        dac161s997_write_reg(dev, DAC161S997_ERR_HIGH_REG, _NA_TO_DAC_TICKS(
-                                 DAC161S997_FAIL_HI_ALARM_NA));
+    err = dac161s997_xfer_batch(dev, ops, ARRAY_SIZE(ops));
+    if (ops[0].err == -ENOEXEC) {
+        return -ENXIO;
+    }
     if (err) {
         return err;
     }
+    if (ops[0].data > _PROTECTED || ops[2].data >= ops[3].data) {
+        return -EIO;
+    }
 
-    err = dac161s997_set_alarm(dev, DAC161S997_ALARM_LOW_FAIL);
-    return err;
+    for (size_t i = 0; i < daccode; i++) {
+        if (ops[i].data != want[i].data) {
+            config_ok = 0;
+            writes[n++] = want[i];
+        }
+    }
+    if (code == _SYNC_ADOPT) {
+        code = config_ok ? ops[daccode].data : want[daccode].data;
+    }
+    if (ops[daccode].data != code) {
+        writes[n] = want[daccode];
+        writes[n++].data = (uint16_t)code;
+    }
+    return n ? dac161s997_xfer_batch(dev, writes, n) : 0;
 }
 
-int dac161s997_set_output(dac161s997_dev_t *dev, int32_t n_amps)
+static int _heal(dac161s997_dev_t *dev, int err, uint32_t *status)
 {
-    if (n_amps < DAC161S997_MIN_NA || n_amps > DAC161S997_MAX_NA) {
-        return -EINVAL;
+    int heal_err;
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    if (!ctx || !ctx->audit.heal ||
+        (err != -ENOEXEC && !(*status & _HEAL_STATUS))) {
+        return err;
     }
-    return dac161s997_write_reg(dev, DAC161S997_DACCODE_REG,
-                                _NA_TO_DAC_TICKS(n_amps));
+    heal_err = dac161s997_recover(dev);
+    if (heal_err) {
+        return heal_err;
+    }
+    /* The device answered the recovery, it is there after all */
+    *status &= ~DAC161S997_STATUS_ABSENT;
+    *status |= DAC161S997_STATUS_RECOVERED;
+    return 0;
 }
 
-int dac161s997_set_alarm(dac161s997_dev_t *dev, DAC161S997_ALARM_t alarm)
+static int _alarm_code(dac161s997_dev_t *dev, DAC161S997_ALARM_t alarm,
+                       uint16_t *code)
 {
     if (alarm == DAC161S997_ALARM_LOW_FAIL) {
-        return dac161s997_write_reg(dev, DAC161S997_DACCODE_REG,
-                                    _NA_TO_DAC_TICKS(DAC161S997_FAIL_LO_ALARM_NA));
+        *code = _FAIL_LO_ALARM_CODE;
     }
     else if (alarm == DAC161S997_ALARM_LOW_SAT) {
-        return dac161s997_write_reg(dev, DAC161S997_DACCODE_REG,
-                                    _NA_TO_DAC_TICKS(DAC161S997_SAT_LO_ALARM_NA));
+        *code = _SAT_LO_ALARM_CODE;
     }
     else if (alarm == DAC161S997_ALARM_HIGH_SAT) {
-        return dac161s997_write_reg(dev, DAC161S997_DACCODE_REG,
-                                    _NA_TO_DAC_TICKS(DAC161S997_SAT_HI_ALARM_NA));
+        *code = _SAT_HI_ALARM_CODE;
     }
     else if (alarm == DAC161S997_ALARM_HIGH_FAIL) {
-        return dac161s997_write_reg(dev, DAC161S997_DACCODE_REG,
-                                    _NA_TO_DAC_TICKS(DAC161S997_FAIL_HI_ALARM_NA));
+        *code = _FAIL_HI_ALARM_CODE;
     }
-    return -EINVAL;
+    else {
+        return -EINVAL;
+    }
+    *code = dac161s997_cal_code(dev, *code);
+    return 0;
 }
 
-int dac161s997_get_status(dac161s997_dev_t *dev, uint32_t *status)
+static void _check_outputs(const int32_t *n_amps, size_t n, uint32_t *err_map)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (i % 32 == 0) {
+            err_map[i / 32] = 0;
+        }
+        if (!dac161s997_na_valid(n_amps[i])) {
+            err_map[i / 32] |= (uint32_t)1 << (i % 32);
+        }
+    }
+}
+
+static int _stage_daccode(dac161s997_dev_t *dev, uint16_t code)
+{
+    uint16_t current;
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+    dac161s997_op_t ops[] = {
+        DAC161S997_OP_WRITE(DAC161S997_PROTECT_REG_WR_REG, _PROTECTED),
+        DAC161S997_OP_WRITE(DAC161S997_DACCODE_REG, code),
+    };
+    int err;
+
+    if (dac161s997_shadow_get(ctx, DAC161S997_DACCODE_REG, &current) &&
+        current == code) {
+        /* Already there, nothing to commit and the device stays direct */
+        return _write_daccode(dev, code);
+    }
+    /* The chip holds the write until XFR, DACCODE is taken as committed */
+    err = dac161s997_xfer_batch(dev, ops, ARRAY_SIZE(ops));
+    if (!err && dac161s997_spi_xfer_multi && ctx && ctx->verify.pending[0]) {
+        /* A broadcast commit would clock out the unchecked echo unread */
+        err = dac161s997_xfer_batch(dev, NULL, 0);
+    }
+    return err;
+}
+
+static int _staged(dac161s997_dev_t *dev)
+{
+    uint16_t protect;
+
+    /* Without a context every channel is staged */
+    return !dac161s997_shadow_get(dac161s997_ctx(dev),
+                                  DAC161S997_PROTECT_REG_WR_REG, &protect) ||
+           protect == _PROTECTED;
+}
+
+static void _lost_daccode(dac161s997_dev_t *dev)
+{
+    uint16_t code;
+    dac161s997_op_t op = DAC161S997_OP_WRITE(DAC161S997_DACCODE_REG, 0);
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    /* The held write may or may not have been committed */
+    if (dac161s997_shadow_get(ctx, DAC161S997_DACCODE_REG, &code)) {
+        op.data = code;
+        op.err = -EIO;
+        dac161s997_shadow_update(ctx, &op);
+    }
+}
+
+static size_t _daccode_ops(dac161s997_dev_t *dev, uint16_t code,
+                           dac161s997_op_t *ops)
+{
+    uint16_t current;
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+    const dac161s997_op_t op = DAC161S997_OP_WRITE(DAC161S997_DACCODE_REG,
+                                                   code);
+
+    if (dac161s997_shadow_get(ctx, DAC161S997_DACCODE_REG, &current) &&
+        current == code) {
+        /* Nothing to change, the NOP only keeps the SPI timeout from expiring */
+        dac161s997_stats_skipped_write(ctx);
+        return 0;
+    }
+    ops[0] = op;
+    return 1;
+}
+
+static int _write_daccode(dac161s997_dev_t *dev, uint16_t code)
+{
+    dac161s997_op_t op;
+    size_t n = _daccode_ops(dev, code, &op);
+
+    if (!n) {
+        return _keepalive(dev);
+    }
+    return dac161s997_xfer_batch(dev, &op, n);
+}
+
+static int _keepalive(dac161s997_dev_t *dev)
+{
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    if (dac161s997_timestamp_ns && ctx->last_frame_ns &&
+        dac161s997_timestamp_ns() - ctx->last_frame_ns <
+        DAC161S997_KEEPALIVE_NS) {
+        /* Seen a frame recently enough, not even a keepalive is needed */
+        return 0;
+    }
+    return dac161s997_keepalive_nop(dev);
+}
+
+static size_t _status_ops(dac161s997_dev_t *dev, dac161s997_op_t *ops)
 {
-    uint16_t data;
     uint16_t alarm;
-    int err = 0;
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+    const dac161s997_op_t status_ops[] = {
+        DAC161S997_OP_READ(DAC161S997_STATUS_REG),
+        DAC161S997_OP_READ(DAC161S997_DACCODE_REG),
+        DAC161S997_OP_READ(DAC161S997_ERR_LOW_REG),
+        DAC161S997_OP_READ(DAC161S997_ERR_HIGH_REG),
+    };
+
+    memcpy(ops, status_ops, sizeof(status_ops));
+    /* The alarm levels only change on init so serve them from the context */
+    if (dac161s997_shadow_get(ctx, DAC161S997_ERR_LOW_REG, &alarm) &&
+        dac161s997_shadow_get(ctx, DAC161S997_ERR_HIGH_REG, &alarm)) {
+        return 2;
+    }
+    return ARRAY_SIZE(status_ops);
+}
+
+static int _status_decode(dac161s997_dev_t *dev, const dac161s997_op_t *ops,
+                          size_t n, uint32_t *status)
+{
+    uint16_t alarm_lo = 0;
+    uint16_t alarm_hi = 0;
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
 
     /* Reset status each call so errors are not sticky */
     *status = 0;
 
-    err = dac161s997_read_reg(dev, DAC161S997_STATUS_REG, &data);
-
-    if (err == -ENOEXEC) {
+    if (ops[0].err == -ENOEXEC) {
         *status |= DAC161S997_STATUS_ABSENT;
     }
-    if (err) {
-        return err;
+    if (ops[0].err) {
+        return ops[0].err;
+    }
+
+    *status |= _status_bits(ops[0].data);
+
+    if (ops[1].err) {
+        return ops[1].err;
     }
 
+    if (n > 2) {
+        if (ops[2].err) {
+            return ops[2].err;
+        }
+        if (ops[3].err) {
+            return ops[3].err;
+        }
+        alarm_lo = ops[2].data;
+        alarm_hi = ops[3].data;
+    }
+    else {
+        dac161s997_shadow_get(ctx, DAC161S997_ERR_LOW_REG, &alarm_lo);
+        dac161s997_shadow_get(ctx, DAC161S997_ERR_HIGH_REG, &alarm_hi);
+    }
+    *status |= _alarm_bits(ops[1].data, alarm_lo, alarm_hi);
+    return 0;
+}
+
+static uint32_t _status_bits(uint16_t data)
+{
+    uint32_t status = 0;
+
     if (data & DAC161S997_STATUS_REG_LOOP_STS) {
-        *status |= DAC161S997_STATUS_LOOP_ERR;
+        status |= DAC161S997_STATUS_LOOP_ERR;
     }
     if (data & DAC161S997_STATUS_REG_SPI_TIMEOUT_ERR) {
-        *status |= DAC161S997_STATUS_COM_TIMEOUT;
+        status |= DAC161S997_STATUS_COM_TIMEOUT;
     }
     if (data & DAC161S997_STATUS_REG_FERR_STS) {
-        *status |= DAC161S997_STATUS_FRAME_ERR;
+        status |= DAC161S997_STATUS_FRAME_ERR;
     }
+    return status;
+}
 
-    err = dac161s997_read_reg(dev, DAC161S997_DACCODE_REG, &data);
-    if (err) {
-        return err;
+static uint32_t _alarm_bits(uint16_t code, uint16_t alarm_lo,
+                            uint16_t alarm_hi)
+{
+    uint32_t status = 0;
+
+    if (code == alarm_lo) {
+        status |= DAC161S997_LO_ALARM_ERR;
+    }
+    if (code == alarm_hi) {
+        status |= DAC161S997_HI_ALARM_ERR;
     }
+    return status;
+}
+
+static int _audit_due(dac161s997_ctx_t *ctx)
+{
+    uint16_t data;
 
-    err = dac161s997_read_reg(dev, DAC161S997_ERR_LOW_REG, &alarm);
-    if (data == alarm) {
-        *status |= DAC161S997_LO_ALARM_ERR;
+    /* Alarm flags cannot be derived from registers the driver lost track of */
+    if (ctx->audit.suspect ||
+        !dac161s997_shadow_get(ctx, DAC161S997_DACCODE_REG, &data) ||
+        !dac161s997_shadow_get(ctx, DAC161S997_ERR_LOW_REG, &data) ||
+        !dac161s997_shadow_get(ctx, DAC161S997_ERR_HIGH_REG, &data)) {
+        return 1;
     }
-    if (err) {
-        return err;
+    return ctx->audit.every && ++ctx->audit.count >= ctx->audit.every;
+}
+
+static int _async_ctx(dac161s997_dev_t *dev, dac161s997_ctx_t **ctx)
+{
+    *ctx = dac161s997_ctx(dev);
+    if (!*ctx || !dac161s997_spi_xfer_async) {
+        return -ENOTSUP;
+    }
+    if ((*ctx)->async.result == -EINPROGRESS) {
+        return -EBUSY;
     }
+    return 0;
+}
+
+static void _async_finish(dac161s997_dev_t *dev, int err)
+{
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+    dac161s997_cb_t cb = ctx->async.cb;
 
-    err = dac161s997_read_reg(dev, DAC161S997_ERR_HIGH_REG, &alarm);
-    if (data == alarm) {
-        *status |= DAC161S997_HI_ALARM_ERR;
+    /* Publish first, the callback may start the next request */
+    ctx->async.result = err;
+    if (cb) {
+        cb(dev, err, ctx->async.arg);
     }
-    return err;
+}
+
+static void _async_finish_init(dac161s997_dev_t *dev, int err)
+{
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    _async_finish(dev, _init_result(ctx->async.ops, err));
+}
+
+static void _async_finish_status(dac161s997_dev_t *dev, int err)
+{
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+    int decode_err = _status_decode(dev, ctx->async.ops, ctx->async.n,
+                                    ctx->async.status);
+
+    /* Same as dac161s997_get_status(), a lazy write error is not dropped */
+    _async_finish(dev, decode_err ? decode_err : err);
 }
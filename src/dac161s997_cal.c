@@ -0,0 +1,116 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+
+#include "dac161s997.h"
+#include "dac161s997_port.h"
+#include "internal/dac161s997_regs.h"
+
+/* Private defines ************************************************************/
+#define _SLOPE_ONE          ((int32_t)1 << 16)
+#define _BUCKETS            ((0xFFFF >> DAC161S997_CAL_BUCKET_SHIFT) + 1)
+
+/* Private functions **********************************************************/
+static int64_t _slope(const dac161s997_cal_point_t *start);
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+int dac161s997_cal_load(dac161s997_cal_t *cal,
+                        const dac161s997_cal_point_t *points, size_t n)
+{
+    size_t seg = 0;
+
+    if (n < 1 || n > DAC161S997_CAL_MAX_POINTS) {
+        return -EINVAL;
+    }
+    for (size_t i = 1; i < n; i++) {
+        if (points[i].measured_na <= points[i - 1].measured_na) {
+            return -EINVAL;
+        }
+    }
+
+    for (size_t i = 1; i < n; i++) {
+        int64_t slope = _slope(&points[i - 1]);
+
+        if (slope < INT32_MIN || slope > INT32_MAX) {
+            return -EINVAL;
+        }
+    }
+
+    /* Segment i starts at point i and runs to point i + 1 */
+    cal->n = (n > 1) ? n - 1 : 1;
+    for (size_t i = 0; i < cal->n; i++) {
+        cal->in_code[i] = dac161s997_na_to_code(points[i].measured_na);
+        cal->out_code[i] = dac161s997_na_to_code(points[i].set_na);
+        cal->slope[i] = (n > 1) ? (int32_t)_slope(&points[i]) : _SLOPE_ONE;
+    }
+    for (size_t b = 0; b < _BUCKETS; b++) {
+        uint32_t start = (uint32_t)b << DAC161S997_CAL_BUCKET_SHIFT;
+
+        while (seg + 1 < cal->n && cal->in_code[seg + 1] <= start) {
+            seg++;
+        }
+        cal->bucket[b] = seg;
+    }
+    return 0;
+}
+
+uint16_t dac161s997_cal_apply(const dac161s997_cal_t *cal, uint16_t code)
+{
+    uint8_t seg = cal->bucket[code >> DAC161S997_CAL_BUCKET_SHIFT];
+    int32_t out;
+
+    /* Only buckets holding a segment start need to step past it, codes below
+     * the first or past the last point extend the outer segments */
+    while (seg + 1 < cal->n && code >= cal->in_code[seg + 1]) {
+        seg++;
+    }
+    out = cal->out_code[seg] +
+          (int32_t)(((int64_t)(code - cal->in_code[seg]) * cal->slope[seg] +
+                     (1 << 15)) >> 16);
+    if (out < 0) {
+        return 0;
+    }
+    if (out > 0xFFFF) {
+        return 0xFFFF;
+    }
+    return out;
+}
+
+uint16_t dac161s997_cal_code(dac161s997_dev_t *dev, uint16_t code)
+{
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    if (ctx && ctx->cal) {
+        return dac161s997_cal_apply(ctx->cal, code);
+    }
+    return code;
+}
+
+int dac161s997_set_cal(dac161s997_dev_t *dev, const dac161s997_cal_t *cal)
+{
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    if (!ctx) {
+        return -ENOTSUP;
+    }
+    ctx->cal = cal;
+    return 0;
+}
+
+static int64_t _slope(const dac161s997_cal_point_t *start)
+{
+    /* Both axes scale the same way, take the slope in nA for precision */
+    return ((int64_t)start[1].set_na - start[0].set_na) * _SLOPE_ONE /
+           ((int64_t)start[1].measured_na - start[0].measured_na);
+}
@@ -0,0 +1,323 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+
+#include "dac161s997.h"
+#include "internal/dac161s997_regs.h"
+
+#ifndef DAC161S997_CONV_SIMD
+/** Set to 0 to build the bulk conversion with the portable kernel only */
+#define DAC161S997_CONV_SIMD    1
+#endif
+
+#if DAC161S997_CONV_SIMD && defined(__SSE2__)
+#define _HAVE_SSE2              1
+#include <emmintrin.h>
+#endif
+#if DAC161S997_CONV_SIMD && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+/* Built for the target with the rest, run only if the CPU has it */
+#define _HAVE_AVX2              1
+#include <immintrin.h>
+#endif
+#if DAC161S997_CONV_SIMD && defined(__ARM_NEON) && defined(__aarch64__)
+#define _HAVE_NEON              1
+#include <arm_neon.h>
+#endif
+
+/* Private defines ************************************************************/
+#define _MAX_CODE           0xFFFF
+/* First current that would round to a code past the 16 bit range */
+#define _MAX_CODE_NA        (24000000 - 183)
+#define _ROUND              (1ULL << (DAC161S997_CODE_SHIFT - 1))
+
+/* Private typedefs ***********************************************************/
+/* Converts up to 32 values, returns the bitmask of those out of range */
+typedef uint32_t (*_kernel_t)(const int32_t *n_amps, uint16_t *codes,
+                              size_t n);
+
+/* Private functions **********************************************************/
+static uint32_t _codes_scalar(const int32_t *n_amps, uint16_t *codes,
+                              size_t n);
+
+static uint32_t _codes_auto(const int32_t *n_amps, uint16_t *codes, size_t n);
+
+static _kernel_t _kernel_of(DAC161S997_CONV_t conv);
+
+#if _HAVE_SSE2
+static uint32_t _codes_sse2(const int32_t *n_amps, uint16_t *codes, size_t n);
+#endif
+#if _HAVE_AVX2
+static uint32_t _codes_avx2(const int32_t *n_amps, uint16_t *codes, size_t n);
+#endif
+#if _HAVE_NEON
+static uint32_t _codes_neon(const int32_t *n_amps, uint16_t *codes, size_t n);
+#endif
+
+/* Private variables **********************************************************/
+/* Accessed atomically, conversions may run while another thread selects */
+static _kernel_t _kernel = _codes_auto;
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+uint16_t dac161s997_na_to_code(int32_t n_amps)
+{
+    if (n_amps <= 0) {
+        return 0;
+    }
+    if (n_amps >= _MAX_CODE_NA) {
+        return _MAX_CODE;
+    }
+    return DAC161S997_NA_TO_CODE_RAW(n_amps);
+}
+
+int32_t dac161s997_code_to_na(uint16_t code)
+{
+    /* code * 46875 / 128, fits 32 bit for all codes */
+    return (int32_t)(((uint32_t)code * 46875 + 64) >> 7);
+}
+
+size_t dac161s997_na_to_codes(const int32_t *n_amps, uint16_t *codes,
+                              size_t n, uint32_t *err_map)
+{
+    size_t bad = 0;
+
+    for (size_t base = 0; base < n; base += 32) {
+        size_t count = (n - base < 32) ? n - base : 32;
+        _kernel_t kernel = __atomic_load_n(&_kernel, __ATOMIC_RELAXED);
+        uint32_t word = kernel(&n_amps[base], &codes[base], count);
+
+        err_map[base / 32] = word;
+        while (word) {
+            word &= word - 1;
+            bad++;
+        }
+    }
+    return bad;
+}
+
+size_t dac161s997_na_to_frames(const int32_t *n_amps, uint8_t *frames,
+                               size_t n, uint32_t *err_map)
+{
+    size_t bad = 0;
+    uint16_t codes[32];
+
+    for (size_t base = 0; base < n; base += 32) {
+        size_t count = (n - base < 32) ? n - base : 32;
+        uint8_t *frame = &frames[base * DAC161S997_FRAME_SIZE];
+
+        bad += dac161s997_na_to_codes(&n_amps[base], codes, count,
+                                      &err_map[base / 32]);
+        for (size_t i = 0; i < count; i++) {
+            frame[0] = DAC161S997_DACCODE_REG;
+            frame[1] = (uint8_t)(codes[i] >> 8);
+            frame[2] = (uint8_t)(codes[i] & 0xFF);
+            frame += DAC161S997_FRAME_SIZE;
+        }
+    }
+    return bad;
+}
+
+int dac161s997_conv_select(DAC161S997_CONV_t conv)
+{
+    _kernel_t kernel = _kernel_of(conv);
+
+    if (!kernel) {
+        return -ENOTSUP;
+    }
+    __atomic_store_n(&_kernel, kernel, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static _kernel_t _kernel_of(DAC161S997_CONV_t conv)
+{
+    switch (conv) {
+    case DAC161S997_CONV_AUTO:
+#if _HAVE_AVX2
+        if (__builtin_cpu_supports("avx2")) {
+            return _codes_avx2;
+        }
+#endif
+#if _HAVE_SSE2
+        return _codes_sse2;
+#elif _HAVE_NEON
+        return _codes_neon;
+#else
+        return _codes_scalar;
+#endif
+    case DAC161S997_CONV_SCALAR:
+        return _codes_scalar;
+#if _HAVE_SSE2
+    case DAC161S997_CONV_SSE2:
+        return _codes_sse2;
+#endif
+#if _HAVE_AVX2
+    case DAC161S997_CONV_AVX2:
+        return __builtin_cpu_supports("avx2") ? _codes_avx2 : NULL;
+#endif
+#if _HAVE_NEON
+    case DAC161S997_CONV_NEON:
+        return _codes_neon;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+static uint32_t _codes_auto(const int32_t *n_amps, uint16_t *codes, size_t n)
+{
+    /* Resolved on first use, unless dac161s997_conv_select() got there first */
+    _kernel_t expected = _codes_auto;
+    _kernel_t kernel = _kernel_of(DAC161S997_CONV_AUTO);
+
+    __atomic_compare_exchange_n(&_kernel, &expected, kernel, 0,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    return kernel(n_amps, codes, n);
+}
+
+static uint32_t _codes_scalar(const int32_t *n_amps, uint16_t *codes,
+                              size_t n)
+{
+    uint32_t bad = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (!dac161s997_na_valid(n_amps[i])) {
+            bad |= (uint32_t)1 << i;
+        }
+        codes[i] = dac161s997_na_to_code(n_amps[i]);
+    }
+    return bad;
+}
+
+/* The vector kernels clamp to 0 .. _MAX_CODE_NA - 1, which rounds to 0 and
+ * _MAX_CODE at the ends, then do the same 32 x 32 bit multiply, rounding and
+ * shift as DAC161S997_NA_TO_CODE_RAW(). What does not fill a vector is left to
+ * the scalar kernel.
+ */
+#if _HAVE_SSE2
+static uint32_t _codes_sse2(const int32_t *n_amps, uint16_t *codes, size_t n)
+{
+    uint32_t bad = 0;
+    size_t i = 0;
+    const __m128i lo = _mm_set1_epi32(DAC161S997_MIN_NA);
+    const __m128i hi = _mm_set1_epi32(DAC161S997_MAX_NA);
+    const __m128i top = _mm_set1_epi32(_MAX_CODE_NA - 1);
+    const __m128i mult = _mm_set1_epi32(DAC161S997_CODE_MULT);
+    const __m128i round = _mm_set1_epi64x(_ROUND);
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&n_amps[i]);
+        __m128i out = _mm_or_si128(_mm_cmpgt_epi32(lo, v),
+                                   _mm_cmpgt_epi32(v, hi));
+        __m128i over = _mm_cmpgt_epi32(v, top);
+        __m128i even, odd;
+
+        bad |= (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(out)) << i;
+        /* No 32 bit min and max before SSE4.1, select with masks instead */
+        v = _mm_andnot_si128(_mm_srai_epi32(v, 31), v);
+        v = _mm_or_si128(_mm_and_si128(over, top), _mm_andnot_si128(over, v));
+
+        even = _mm_add_epi64(_mm_mul_epu32(v, mult), round);
+        odd = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(v, 32), mult), round);
+        even = _mm_srli_epi64(even, DAC161S997_CODE_SHIFT);
+        odd = _mm_slli_epi64(_mm_srli_epi64(odd, DAC161S997_CODE_SHIFT), 32);
+        /* Only a signed saturating pack, so move the codes to signed range */
+        v = _mm_sub_epi32(_mm_or_si128(even, odd), bias32);
+        v = _mm_xor_si128(_mm_packs_epi32(v, v), bias16);
+        _mm_storel_epi64((__m128i *)&codes[i], v);
+    }
+    if (i < n) {
+        bad |= _codes_scalar(&n_amps[i], &codes[i], n - i) << i;
+    }
+    return bad;
+}
+#endif
+
+#if _HAVE_AVX2
+__attribute__((target("avx2")))
+static uint32_t _codes_avx2(const int32_t *n_amps, uint16_t *codes, size_t n)
+{
+    uint32_t bad = 0;
+    size_t i = 0;
+    const __m256i lo = _mm256_set1_epi32(DAC161S997_MIN_NA);
+    const __m256i hi = _mm256_set1_epi32(DAC161S997_MAX_NA);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i top = _mm256_set1_epi32(_MAX_CODE_NA - 1);
+    const __m256i mult = _mm256_set1_epi32(DAC161S997_CODE_MULT);
+    const __m256i round = _mm256_set1_epi64x(_ROUND);
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&n_amps[i]);
+        __m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(lo, v),
+                                      _mm256_cmpgt_epi32(v, hi));
+        __m256i even, odd;
+        __m128i packed;
+
+        bad |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(out)) << i;
+        v = _mm256_min_epi32(_mm256_max_epi32(v, zero), top);
+
+        even = _mm256_add_epi64(_mm256_mul_epu32(v, mult), round);
+        odd = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(v, 32),
+                                                mult), round);
+        even = _mm256_srli_epi64(even, DAC161S997_CODE_SHIFT);
+        odd = _mm256_slli_epi64(_mm256_srli_epi64(odd, DAC161S997_CODE_SHIFT),
+                                32);
+        v = _mm256_or_si256(even, odd);
+        /* Codes fit 16 bit, the unsigned saturating pack keeps them as is */
+        packed = _mm_packus_epi32(_mm256_castsi256_si128(v),
+                                  _mm256_extracti128_si256(v, 1));
+        _mm_storeu_si128((__m128i *)&codes[i], packed);
+    }
+    if (i < n) {
+        bad |= _codes_scalar(&n_amps[i], &codes[i], n - i) << i;
+    }
+    return bad;
+}
+#endif
+
+#if _HAVE_NEON
+static uint32_t _codes_neon(const int32_t *n_amps, uint16_t *codes, size_t n)
+{
+    uint32_t bad = 0;
+    size_t i = 0;
+    const int32x4_t lo = vdupq_n_s32(DAC161S997_MIN_NA);
+    const int32x4_t hi = vdupq_n_s32(DAC161S997_MAX_NA);
+    const uint32x4_t bits = { 1, 2, 4, 8 };
+    const uint64x2_t round = vdupq_n_u64(_ROUND);
+    const uint32x2_t mult = vdup_n_u32(DAC161S997_CODE_MULT);
+
+    for (; i + 4 <= n; i += 4) {
+        int32x4_t v = vld1q_s32(&n_amps[i]);
+        uint32x4_t out = vorrq_u32(vcltq_s32(v, lo), vcgtq_s32(v, hi));
+        uint32x4_t u;
+        uint64x2_t low, high;
+
+        bad |= (uint32_t)vaddvq_u32(vandq_u32(out, bits)) << i;
+        u = vreinterpretq_u32_s32(vminq_s32(vmaxq_s32(v, vdupq_n_s32(0)),
+                                            vdupq_n_s32(_MAX_CODE_NA - 1)));
+
+        low = vmlal_u32(round, vget_low_u32(u), mult);
+        high = vmlal_u32(round, vget_high_u32(u), mult);
+        low = vshrq_n_u64(low, DAC161S997_CODE_SHIFT);
+        high = vshrq_n_u64(high, DAC161S997_CODE_SHIFT);
+        vst1_u16(&codes[i], vmovn_u32(vcombine_u32(vmovn_u64(low),
+                                                   vmovn_u64(high))));
+    }
+    if (i < n) {
+        bad |= _codes_scalar(&n_amps[i], &codes[i], n - i) << i;
+    }
+    return bad;
+}
+#endif
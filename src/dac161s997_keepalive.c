@@ -0,0 +1,71 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+
+#include "dac161s997.h"
+#include "dac161s997_port.h"
+#include "internal/dac161s997_regs.h"
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+void dac161s997_keepalive_init(dac161s997_keepalive_t *ka,
+                               dac161s997_dev_t *const *devs, size_t n,
+                               size_t max_per_poll)
+{
+    ka->devs = devs;
+    ka->n = n;
+    ka->period_ns = DAC161S997_KEEPALIVE_NS;
+    ka->window_ns = DAC161S997_KEEPALIVE_NS / 2;
+    ka->max_per_poll = max_per_poll;
+    ka->next = 0;
+}
+
+int dac161s997_keepalive_poll(dac161s997_keepalive_t *ka)
+{
+    int err;
+    int first_err = 0;
+    size_t sent = 0;
+    size_t start = ka->next;
+    uint64_t now;
+
+    if (!dac161s997_timestamp_ns) {
+        return -ENOTSUP;
+    }
+    now = dac161s997_timestamp_ns();
+
+    for (size_t k = 0; k < ka->n; k++) {
+        size_t i = (start + k) % ka->n;
+        dac161s997_ctx_t *ctx = dac161s997_ctx(ka->devs[i]);
+        uint64_t idle = UINT64_MAX;
+
+        if (ctx && ctx->last_frame_ns) {
+            idle = now - ctx->last_frame_ns;
+        }
+        if (idle < ka->period_ns - ka->window_ns) {
+            continue;
+        }
+        if (idle < ka->period_ns && ka->max_per_poll &&
+            sent >= ka->max_per_poll) {
+            continue;
+        }
+
+        err = dac161s997_keepalive_nop(ka->devs[i]);
+        if (err && !first_err) {
+            first_err = err;
+        }
+        sent++;
+        /* Let the next poll start after the last device served */
+        ka->next = (i + 1) % ka->n;
+    }
+    return first_err;
+}
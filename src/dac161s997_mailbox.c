@@ -0,0 +1,167 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+
+#include "dac161s997.h"
+#include "dac161s997_mailbox.h"
+
+/* Private defines ************************************************************/
+/* Flags a posted word, the request fits in the bits below */
+#define _POSTED             0x80000000UL
+#define _REQUEST_MASK       0x7FFFFFFFUL
+
+/* Private functions **********************************************************/
+static void _post(dac161s997_mailbox_t *mb, uint32_t *word, uint32_t req);
+
+static void _slot_sent(dac161s997_slot_t *slot);
+
+static void _slot_done(dac161s997_dev_t *dev, int err, void *arg);
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+void dac161s997_mailbox_init(dac161s997_mailbox_t *mb)
+{
+    mb->setpoint = 0;
+    mb->alarm = 0;
+    mb->coalesced = 0;
+    mb->held_na = 0;
+    mb->latched = 0;
+    mb->has_held = 0;
+    mb->dirty = 0;
+}
+
+int dac161s997_mailbox_post(dac161s997_mailbox_t *mb, int32_t n_amps)
+{
+    if (!dac161s997_na_valid(n_amps)) {
+        return -EINVAL;
+    }
+    _post(mb, &mb->setpoint, (uint32_t)n_amps);
+    return 0;
+}
+
+int dac161s997_mailbox_alarm(dac161s997_mailbox_t *mb,
+                             DAC161S997_ALARM_t alarm)
+{
+    if (alarm != DAC161S997_ALARM_LOW_FAIL &&
+        alarm != DAC161S997_ALARM_LOW_SAT &&
+        alarm != DAC161S997_ALARM_HIGH_SAT &&
+        alarm != DAC161S997_ALARM_HIGH_FAIL) {
+        return -EINVAL;
+    }
+    _post(mb, &mb->alarm, (uint32_t)alarm);
+    return 0;
+}
+
+void dac161s997_mailbox_clear_alarm(dac161s997_mailbox_t *mb)
+{
+    _post(mb, &mb->alarm, 0);
+}
+
+int dac161s997_mailbox_drain(dac161s997_dev_t *dev, dac161s997_mailbox_t *mb)
+{
+    int err;
+    uint32_t alarm = __atomic_exchange_n(&mb->alarm, 0, __ATOMIC_ACQUIRE);
+    uint32_t setpoint = __atomic_exchange_n(&mb->setpoint, 0,
+                                            __ATOMIC_ACQUIRE);
+
+    if (alarm) {
+        mb->latched = (uint16_t)(alarm & _REQUEST_MASK);
+        mb->dirty = 1;
+    }
+    if (setpoint) {
+        mb->held_na = (int32_t)(setpoint & _REQUEST_MASK);
+        mb->has_held = 1;
+        /* Only goes out once the alarm is released */
+        mb->dirty |= !mb->latched;
+    }
+    if (!mb->dirty) {
+        return 0;
+    }
+
+    if (mb->latched) {
+        err = dac161s997_set_alarm(dev, (DAC161S997_ALARM_t)mb->latched);
+    }
+    else if (mb->has_held) {
+        err = dac161s997_set_output(dev, mb->held_na);
+    }
+    else {
+        /* Alarm cleared before any setpoint, nothing to restore */
+        err = 0;
+    }
+    if (!err) {
+        mb->dirty = 0;
+    }
+    return err;
+}
+
+void dac161s997_slot_init(dac161s997_slot_t *slot)
+{
+    slot->latest = 0;
+    slot->flushed = 0;
+    slot->in_flight = 0;
+    slot->coalesced = 0;
+}
+
+int dac161s997_slot_flush(dac161s997_dev_t *dev, dac161s997_slot_t *slot)
+{
+    int err;
+    /* Sequence and code come from the same store, no ordering needed */
+    uint32_t latest = __atomic_load_n(&slot->latest, __ATOMIC_RELAXED);
+
+    /* The code is compared too, the sequence wraps after 65536 posts */
+    slot->in_flight = latest;
+    if (latest == slot->flushed) {
+        return 0;
+    }
+    err = dac161s997_set_code(dev, (uint16_t)latest);
+    if (!err) {
+        _slot_sent(slot);
+    }
+    return err;
+}
+
+int dac161s997_slot_flush_start(dac161s997_dev_t *dev,
+                                dac161s997_slot_t *slot)
+{
+    uint32_t latest = __atomic_load_n(&slot->latest, __ATOMIC_RELAXED);
+
+    if (latest == slot->flushed) {
+        return -EALREADY;
+    }
+    slot->in_flight = latest;
+    return dac161s997_set_code_start(dev, (uint16_t)latest, _slot_done, slot);
+}
+
+static void _post(dac161s997_mailbox_t *mb, uint32_t *word, uint32_t req)
+{
+    uint32_t old = __atomic_exchange_n(word, _POSTED | req, __ATOMIC_RELEASE);
+
+    if (old) {
+        __atomic_fetch_add(&mb->coalesced, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void _slot_sent(dac161s997_slot_t *slot)
+{
+    slot->coalesced += (uint16_t)((slot->in_flight >> 16) -
+                                  (slot->flushed >> 16) - 1);
+    slot->flushed = slot->in_flight;
+}
+
+static void _slot_done(dac161s997_dev_t *dev, int err, void *arg)
+{
+    (void)dev;
+    if (!err) {
+        _slot_sent(arg);
+    }
+}
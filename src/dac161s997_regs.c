@@ -8,84 +8,817 @@
 
 /* Includes *******************************************************************/
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 #include <errno.h>
 #include <assert.h>
 
 #include "dac161s997.h"
 #include "dac161s997_port.h"
 #include "internal/dac161s997_regs.h"
+#include "internal/dac161s997_stats.h"
+#include "internal/dac161s997_trace_hooks.h"
 
 /* Private defines ************************************************************/
-#define _SPI_READ_MASK      0x80
+#define _FRAME_SIZE         DAC161S997_FRAME_SIZE
+#define _BATCH_CHUNK        8   /**< Ops encoded at once, bounds stack usage */
+
+/* What follows the last op of a batch */
+#define _TAIL_NOP           0   /**< A NOP clocks out the last echo */
+#define _TAIL_LAZY          1   /**< The next frame checks the last echo */
+#define _TAIL_NONE          2   /**< The last echo is not checked */
+
+#ifndef DAC161S997_MIN_CS_HIGH_NS
+/** Minimum time chip select stays high between two frames */
+#define DAC161S997_MIN_CS_HIGH_NS   100
+#endif
+
+/* Private variables **********************************************************/
+/* End of the last frame on any device, written from threads and from
+ * dac161s997_xfer_done() in interrupts. Only the low 32 bits are kept so
+ * every access is a single atomic word, the gaps that matter are far below
+ * the 4 s wrap.
+ */
+static uint32_t _last_frame_ns;
 
 /* Private functions *************************************************************/
-static int _dac161s997_op_reg(dac161s997_dev_t *dev, uint8_t addr,
-                                  uint16_t *data);
+static int _batch(dac161s997_dev_t *dev, dac161s997_ctx_t *ctx,
+                  dac161s997_op_t *ops, size_t n);
+
+static int _xfer_chunk(dac161s997_dev_t *dev, dac161s997_ctx_t *ctx,
+                       uint8_t *out_buf, uint8_t *in_buf, size_t frames);
+
+static int _batch_fail(dac161s997_ctx_t *ctx, dac161s997_op_t *ops, size_t n,
+                       size_t op, int first_err, int err);
+
+static void _xfer_each(dac161s997_dev_t *const *devs, size_t n,
+                       uint8_t *tx_buf, uint8_t *rx_buf, int *errs);
+
+static int _tail(const dac161s997_ctx_t *ctx, const dac161s997_op_t *ops,
+                 size_t n);
+
+static void _tail_count(dac161s997_ctx_t *ctx, const dac161s997_op_t *ops,
+                        size_t n);
+
+static int _is_status_read(const dac161s997_op_t *op);
+
+static void _batch_tail(dac161s997_ctx_t *ctx, dac161s997_op_t *ops,
+                        size_t n);
+
+static void _verify_pending(dac161s997_ctx_t *ctx, const uint8_t *rx_buf,
+                            int err);
+
+static int _verify_result(dac161s997_ctx_t *ctx, int err);
+
+static int _decode_frame(const uint8_t *buf, dac161s997_op_t *op);
 
-static void _inter_packet_delay();
+static int _async_next_frame(dac161s997_dev_t *dev, dac161s997_ctx_t *ctx);
+
+static void _inter_packet_delay(void);
+
+static uint32_t _since_last_frame(void);
+
+static void _frame_end(dac161s997_ctx_t *ctx, const uint8_t *tx_buf,
+                       const uint8_t *rx_buf, int err, size_t frames);
+
+static int _echoes_ok(const dac161s997_ctx_t *ctx, const uint8_t *tx_buf,
+                      const uint8_t *rx_buf, size_t frames);
 
 /******************************************************************************/
 /* Functions                                                                  */
 /******************************************************************************/
 int dac161s997_write_reg(dac161s997_dev_t *dev,
                              uint8_t addr, uint16_t data)
+{
+    dac161s997_op_t op = { .addr = addr, .data = data };
+
+    return dac161s997_xfer_batch(dev, &op, 1);
+}
+
+int dac161s997_read_reg(dac161s997_dev_t *dev, uint8_t addr,
+                            uint16_t *data)
 {
     int err;
-    uint16_t expect_data = data;
+    dac161s997_op_t op = { .addr = addr | DAC161S997_REG_READ };
 
-    err = _dac161s997_op_reg(dev, addr, &data);
+    err = dac161s997_xfer_batch(dev, &op, 1);
+    if (!err) {
+        *data = op.data;
+    }
+    return err;
+}
+
+int dac161s997_xfer_batch(dac161s997_dev_t *dev, dac161s997_op_t *ops,
+                          size_t n)
+{
+    int err;
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    uint16_t status = 0;
+
+    dac161s997_trace_call(ctx, DAC161S997_TRACE_CALL_BATCH, n);
+    err = _batch(dev, ctx, ops, n);
+    for (uint8_t retry = 0; ctx && retry < ctx->verify.retries; retry++) {
+        size_t first = 0;
+
+        while (first < n && ops[first].err != -ENOEXEC) {
+            first++;
+        }
+        if (err != -ENOEXEC || first == n) {
+            break;
+        }
+        /* Resend in order, a late reset must not undo the ops after it */
+        for (size_t i = first; i < n; i++) {
+            dac161s997_stats_retry(ctx);
+            /* Reading STATUS cleared its sticky bits, keep what was seen */
+            if (_is_status_read(&ops[i]) && !ops[i].err) {
+                status |= ops[i].data;
+            }
+        }
+        err = _batch(dev, ctx, &ops[first], n - first);
+        for (size_t i = first; i < n; i++) {
+            if (_is_status_read(&ops[i]) && !ops[i].err) {
+                ops[i].data |= status;
+            }
+        }
+    }
+    _tail_count(ctx, ops, n);
+    return _verify_result(ctx, err);
+}
+
+int dac161s997_read_pipelined(dac161s997_dev_t *dev, uint8_t addr,
+                              uint16_t *data)
+{
+    int err;
+    uint8_t tx_buf[_FRAME_SIZE];
+    uint8_t rx_buf[_FRAME_SIZE];
+    dac161s997_op_t op = { .addr = addr | DAC161S997_REG_READ };
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    if (!ctx) {
+        return -ENOTSUP;
+    }
+    dac161s997_trace_call(ctx, DAC161S997_TRACE_CALL_READ, 1);
+    dac161s997_encode_frame(tx_buf, op.addr, 0);
+    if (ctx->read_in_flight != op.addr) {
+        err = dac161s997_xfer_frame(dev, tx_buf, rx_buf);
+        if (err) {
+            return err;
+        }
+    }
+    err = dac161s997_xfer_frame(dev, tx_buf, rx_buf);
     if (err) {
         return err;
     }
-    if (data != expect_data) {
-        return -ENOEXEC;
+    if (_decode_frame(rx_buf, &op)) {
+        dac161s997_stats_echo_error(ctx);
+        return op.err;
+    }
+    dac161s997_shadow_update(ctx, &op);
+    ctx->read_in_flight = op.addr;
+    *data = op.data;
+    return 0;
+}
+
+int dac161s997_set_verify(dac161s997_dev_t *dev, DAC161S997_VERIFY_t policy,
+                          uint16_t every_n, uint8_t retries)
+{
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    if (policy > DAC161S997_VERIFY_CONFIG_ONLY ||
+        (policy == DAC161S997_VERIFY_EVERY_N && !every_n)) {
+        return -EINVAL;
+    }
+    if (!ctx) {
+        return -ENOTSUP;
+    }
+    ctx->verify.policy = policy;
+    ctx->verify.every_n = every_n;
+    ctx->verify.count = 0;
+    ctx->verify.retries = retries;
+    return 0;
+}
+
+int dac161s997_xfer_batch_start(dac161s997_dev_t *dev, size_t n,
+                                    void (*finish)(dac161s997_dev_t *dev,
+                                                   int err))
+{
+    int err;
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    assert(n <= DAC161S997_ASYNC_MAX_OPS);
+
+    ctx->async.n = n;
+    ctx->async.frames = n + (_tail(ctx, ctx->async.ops, n) == _TAIL_NOP);
+    ctx->async.frame = 0;
+    ctx->async.err = 0;
+    ctx->async.finish = finish;
+    ctx->async.result = -EINPROGRESS;
+
+    dac161s997_trace_call(ctx, DAC161S997_TRACE_CALL_BATCH, n);
+    err = _async_next_frame(dev, ctx);
+    if (err) {
+        /* Nothing went out, same as a blocking batch failing on its first frame */
+        _batch_fail(ctx, ctx->async.ops, n, 0, 0, err);
+        ctx->async.result = err;
+        return err;
     }
+    _tail_count(ctx, ctx->async.ops, n);
+    return 0;
+}
+
+int dac161s997_xfer_frame(dac161s997_dev_t *dev, uint8_t *tx_buf,
+                              uint8_t *rx_buf)
+{
+    int err;
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
 
+    _inter_packet_delay();
+    err = dac161s997_spi_xfer(dev, tx_buf, rx_buf, _FRAME_SIZE);
+    _frame_end(ctx, tx_buf, rx_buf, err, 1);
+    _verify_pending(ctx, rx_buf, err);
     return err;
 }
 
-int dac161s997_read_reg(dac161s997_dev_t *dev, uint8_t addr,
-                            uint16_t *data)
+int dac161s997_xfer_frame_multi(dac161s997_dev_t *const *devs, size_t n,
+                                uint8_t *tx_buf, uint32_t *failed)
 {
-    return _dac161s997_op_reg(dev, addr | _SPI_READ_MASK, data);
+    int err = -ENOTSUP;
+    int first_err = 0;
+    uint8_t rx_buf[_FRAME_SIZE] = { 0 };
+
+    assert(n <= 32);
+
+    *failed = 0;
+    for (size_t i = 0; i < n; i++) {
+        dac161s997_trace_call(dac161s997_ctx(devs[i]),
+                              DAC161S997_TRACE_CALL_FRAME, 1);
+    }
+    if (dac161s997_spi_xfer_multi && n > 1) {
+        _inter_packet_delay();
+        err = dac161s997_spi_xfer_multi(devs, n, tx_buf, _FRAME_SIZE);
+    }
+    for (size_t i = 0; i < n; i++) {
+        int frame_err = err;
+        dac161s997_ctx_t *ctx = dac161s997_ctx(devs[i]);
+
+        if (err == -ENOTSUP) {
+            frame_err = dac161s997_xfer_frame(devs[i], tx_buf, rx_buf);
+        }
+        else {
+            /* All chips drove MISO together, no echo can be told apart */
+            _frame_end(ctx, tx_buf, rx_buf, err, 1);
+            _verify_pending(ctx, rx_buf, err ? err : -EIO);
+        }
+        if (frame_err) {
+            *failed |= (uint32_t)1 << i;
+            if (!first_err) {
+                first_err = frame_err;
+            }
+        }
+        else if (ctx) {
+            memcpy(ctx->verify.pending, tx_buf, _FRAME_SIZE);
+        }
+    }
+    return first_err;
 }
 
-static int _dac161s997_op_reg(dac161s997_dev_t *dev, uint8_t addr,
-                                  uint16_t *data)
+int dac161s997_xfer_batch_each(dac161s997_dev_t *const *devs,
+                               dac161s997_op_t *ops, size_t n,
+                               uint32_t *failed)
 {
-    int err = 0;
-    uint8_t in_buf[3] = { 0 };
-    uint8_t out_buf[3];
+    int first_err = 0;
+    int errs[32];
+    uint8_t tx_buf[32 * _FRAME_SIZE];
+    uint8_t rx_buf[32 * _FRAME_SIZE];
+    dac161s997_dev_t *group[32];
+    size_t idx[32];
+    size_t count = 0;
+
+    assert(n <= 32);
+
+    *failed = 0;
+    for (size_t i = 0; i < n; i++) {
+        dac161s997_trace_call(dac161s997_ctx(devs[i]),
+                              DAC161S997_TRACE_CALL_BATCH, 1);
+        dac161s997_encode_frame(&tx_buf[i * _FRAME_SIZE], ops[i].addr,
+                                ops[i].data);
+    }
+    /* First pass, the op of every device */
+    _xfer_each(devs, n, tx_buf, rx_buf, errs);
+    for (size_t i = 0; i < n; i++) {
+        dac161s997_ctx_t *ctx = dac161s997_ctx(devs[i]);
+
+        if (errs[i]) {
+            _batch_fail(ctx, &ops[i], 1, 0, 0, errs[i]);
+        }
+        else if (_tail(ctx, &ops[i], 1) == _TAIL_NOP) {
+            group[count] = devs[i];
+            idx[count] = i;
+            dac161s997_encode_frame(&tx_buf[count * _FRAME_SIZE],
+                                    DAC161S997_NOP_REG, 0);
+            count++;
+        }
+        else {
+            _batch_tail(ctx, &ops[i], 1);
+        }
+        _tail_count(ctx, &ops[i], 1);
+    }
+    /* Second pass, NOPs clock out the echoes still to be checked */
+    if (count) {
+        _xfer_each(group, count, tx_buf, rx_buf, errs);
+    }
+    for (size_t k = 0; k < count; k++) {
+        dac161s997_op_t *op = &ops[idx[k]];
+        dac161s997_ctx_t *ctx = dac161s997_ctx(group[k]);
+
+        if (errs[k]) {
+            op->err = errs[k];
+        }
+        else if (_decode_frame(&rx_buf[k * _FRAME_SIZE], op)) {
+            dac161s997_stats_echo_error(ctx);
+        }
+        dac161s997_shadow_update(ctx, op);
+        /* Mismatches are resent on their own, as by dac161s997_xfer_batch() */
+        for (uint8_t retry = 0; ctx && retry < ctx->verify.retries &&
+                                op->err == -ENOEXEC; retry++) {
+            dac161s997_stats_retry(ctx);
+            _batch(group[k], ctx, op, 1);
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        int err = _verify_result(dac161s997_ctx(devs[i]), ops[i].err);
+
+        if (err) {
+            *failed |= (uint32_t)1 << i;
+            if (!first_err) {
+                first_err = err;
+            }
+        }
+    }
+    return first_err;
+}
+
+void dac161s997_xfer_done(dac161s997_dev_t *dev, int err)
+{
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+    dac161s997_op_t *ops = ctx->async.ops;
+    size_t frame = ctx->async.frame;
+
+    _frame_end(ctx, ctx->async.tx_buf, ctx->async.rx_buf, err, 1);
+    _verify_pending(ctx, ctx->async.rx_buf, err);
+    if (err) {
+        /* The previous echo is lost and the rest is not sent */
+        for (size_t j = (frame > 0) ? frame - 1 : 0; j < ctx->async.n; j++) {
+            ops[j].err = err;
+            dac161s997_shadow_update(ctx, &ops[j]);
+        }
+        ctx->async.finish(dev, _verify_result(ctx, ctx->async.err ?
+                                                   ctx->async.err : err));
+        return;
+    }
+    if (frame > 0) {
+        if (_decode_frame(ctx->async.rx_buf, &ops[frame - 1])) {
+            dac161s997_stats_echo_error(ctx);
+            if (!ctx->async.err) {
+                ctx->async.err = ops[frame - 1].err;
+            }
+        }
+        dac161s997_shadow_update(ctx, &ops[frame - 1]);
+    }
+
+    ctx->async.frame++;
+    if (ctx->async.frame >= ctx->async.frames) {
+        if (ctx->async.frames == ctx->async.n) {
+            _batch_tail(ctx, ops, ctx->async.n);
+        }
+        ctx->async.finish(dev, _verify_result(ctx, ctx->async.err));
+        return;
+    }
+    err = _async_next_frame(dev, ctx);
+    if (err) {
+        for (size_t j = frame; j < ctx->async.n; j++) {
+            ops[j].err = err;
+            dac161s997_shadow_update(ctx, &ops[j]);
+        }
+        ctx->async.finish(dev, _verify_result(ctx, ctx->async.err ?
+                                                   ctx->async.err : err));
+    }
+}
+
+int dac161s997_keepalive_nop(dac161s997_dev_t *dev)
+{
+    int err = dac161s997_xfer_batch(dev, NULL, 0);
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    if (err || !ctx || !dac161s997_timestamp_ns || ctx->last_frame_ns) {
+        return err;
+    }
+    /* The echo was that of an earlier frame, which may have been lost.
+     * Decide on the echo of this NOP, clocked out by a second one.
+     */
+    err = dac161s997_xfer_batch(dev, NULL, 0);
+    if (!err && !ctx->last_frame_ns) {
+        return -ENOEXEC;
+    }
+    return err;
+}
+
+dac161s997_ctx_t *dac161s997_ctx(dac161s997_dev_t *dev)
+{
+    if (!dac161s997_get_ctx) {
+        return NULL;
+    }
+    return dac161s997_get_ctx(dev);
+}
+
+int dac161s997_shadow_get(const dac161s997_ctx_t *ctx, uint8_t addr,
+                              uint16_t *data)
+{
+    uint8_t idx = addr - DAC161S997_SHADOW_FIRST_REG;
+
+    if (!ctx || addr < DAC161S997_SHADOW_FIRST_REG ||
+        addr > DAC161S997_SHADOW_LAST_REG) {
+        return 0;
+    }
+    if (!(ctx->shadow_valid & (1 << idx))) {
+        return 0;
+    }
+    *data = ctx->shadow[idx];
+    return 1;
+}
 
+void dac161s997_encode_frame(uint8_t *buf, uint8_t addr, uint16_t data)
+{
     /* Assert addr is in range */
-    assert((addr & (~_SPI_READ_MASK)) > 0);
-    assert((addr & (~_SPI_READ_MASK)) <= 9);
+    assert((addr & (~DAC161S997_REG_READ)) > 0);
+    assert((addr & (~DAC161S997_REG_READ)) <= 9);
+
+    buf[0] = addr;
+    buf[1] = (data >> 8);
+    buf[2] = (data & 0xFF);
+}
+
+static int _batch(dac161s997_dev_t *dev, dac161s997_ctx_t *ctx,
+                  dac161s997_op_t *ops, size_t n)
+{
+    int err = 0;
+    int first_err = 0;
+    uint8_t in_buf[_BATCH_CHUNK * _FRAME_SIZE] = { 0 };
+    uint8_t out_buf[_BATCH_CHUNK * _FRAME_SIZE];
+    size_t total = n + (_tail(ctx, ops, n) == _TAIL_NOP);
+    size_t base = 0;
+
+    /* Op i is sent in frame i and its echo comes back in frame i + 1 */
+    do {
+        size_t frames = total - base;
 
-    out_buf[0] = addr;
-    out_buf[1] = (*data >> 8);
-    out_buf[2] = (*data & 0xFF);
-    err =  dac161s997_spi_xfer(dev, out_buf, in_buf, 3);
+        if (frames > _BATCH_CHUNK) {
+            frames = _BATCH_CHUNK;
+        }
+        for (size_t i = 0; i < frames; i++) {
+            if (base + i < n) {
+                dac161s997_encode_frame(&out_buf[i * _FRAME_SIZE],
+                                        ops[base + i].addr,
+                                        ops[base + i].data);
+            }
+            else {
+                dac161s997_encode_frame(&out_buf[i * _FRAME_SIZE],
+                                        DAC161S997_NOP_REG, 0);
+            }
+        }
 
+        if (dac161s997_spi_xfer_vec) {
+            err = _xfer_chunk(dev, ctx, out_buf, in_buf, frames);
+            if (err) {
+                return _batch_fail(ctx, ops, n, base, first_err, err);
+            }
+        }
+        for (size_t i = 0; i < frames; i++) {
+            size_t op = base + i;
+
+            if (!dac161s997_spi_xfer_vec) {
+                err = dac161s997_xfer_frame(dev, &out_buf[i * _FRAME_SIZE],
+                                            &in_buf[i * _FRAME_SIZE]);
+                if (err) {
+                    return _batch_fail(ctx, ops, n, op, first_err, err);
+                }
+            }
+            if (op > 0) {
+                if (_decode_frame(&in_buf[i * _FRAME_SIZE], &ops[op - 1])) {
+                    dac161s997_stats_echo_error(ctx);
+                    if (!first_err) {
+                        first_err = ops[op - 1].err;
+                    }
+                }
+                dac161s997_shadow_update(ctx, &ops[op - 1]);
+            }
+        }
+        base += frames;
+    } while (base < total);
+
+    if (total == n) {
+        _batch_tail(ctx, ops, n);
+    }
+    return first_err;
+}
+
+static int _xfer_chunk(dac161s997_dev_t *dev, dac161s997_ctx_t *ctx,
+                       uint8_t *out_buf, uint8_t *in_buf, size_t frames)
+{
+    int err;
+    dac161s997_spi_seg_t segs[_BATCH_CHUNK];
+
+    for (size_t i = 0; i < frames; i++) {
+        segs[i].tx_buf = &out_buf[i * _FRAME_SIZE];
+        segs[i].rx_buf = &in_buf[i * _FRAME_SIZE];
+        segs[i].size = _FRAME_SIZE;
+        /* The chip latches each frame on the rising chip select */
+        segs[i].cs_change = 1;
+    }
     _inter_packet_delay();
+    err = dac161s997_spi_xfer_vec(dev, segs, frames);
+    _frame_end(ctx, out_buf, in_buf, err, frames);
+    _verify_pending(ctx, in_buf, err);
+    return err;
+}
+
+static int _batch_fail(dac161s997_ctx_t *ctx, dac161s997_op_t *ops, size_t n,
+                       size_t op, int first_err, int err)
+{
+    /* The echo of the op before is lost and the rest is not sent */
+    for (size_t j = (op > 0) ? op - 1 : 0; j < n; j++) {
+        ops[j].err = err;
+        dac161s997_shadow_update(ctx, &ops[j]);
+    }
+    return first_err ? first_err : err;
+}
+
+static void _xfer_each(dac161s997_dev_t *const *devs, size_t n,
+                       uint8_t *tx_buf, uint8_t *rx_buf, int *errs)
+{
+    int err = -ENOTSUP;
+
+    if (dac161s997_spi_xfer_each && n > 1) {
+        _inter_packet_delay();
+        err = dac161s997_spi_xfer_each(devs, n, tx_buf, rx_buf, _FRAME_SIZE);
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint8_t *tx = &tx_buf[i * _FRAME_SIZE];
+        uint8_t *rx = &rx_buf[i * _FRAME_SIZE];
+        dac161s997_ctx_t *ctx = dac161s997_ctx(devs[i]);
+
+        if (err == -ENOTSUP) {
+            errs[i] = dac161s997_xfer_frame(devs[i], tx, rx);
+            continue;
+        }
+        errs[i] = err;
+        _frame_end(ctx, tx, rx, err, 1);
+        _verify_pending(ctx, rx, err);
+    }
+}
+
+static int _tail(const dac161s997_ctx_t *ctx, const dac161s997_op_t *ops,
+                 size_t n)
+{
+    uint8_t addr;
+
+    if (!ctx || !n || (ops[n - 1].addr & DAC161S997_REG_READ)) {
+        return _TAIL_NOP;
+    }
+    addr = ops[n - 1].addr;
+    switch (ctx->verify.policy) {
+    case DAC161S997_VERIFY_LAZY:
+        return _TAIL_LAZY;
+    case DAC161S997_VERIFY_EVERY_N:
+        /* The call that brings the count to every_n is verified */
+        return (ctx->verify.count + 1u >= ctx->verify.every_n) ? _TAIL_NOP :
+                                                                 _TAIL_NONE;
+    case DAC161S997_VERIFY_CONFIG_ONLY:
+        return (addr == DAC161S997_DACCODE_REG) ? _TAIL_NONE : _TAIL_NOP;
+    default:
+        return _TAIL_NOP;
+    }
+}
+
+static void _tail_count(dac161s997_ctx_t *ctx, const dac161s997_op_t *ops,
+                        size_t n)
+{
+    /* Once per call, whatever the retries */
+    if (!ctx || ctx->verify.policy != DAC161S997_VERIFY_EVERY_N || !n ||
+        (ops[n - 1].addr & DAC161S997_REG_READ)) {
+        return;
+    }
+    if (++ctx->verify.count >= ctx->verify.every_n) {
+        ctx->verify.count = 0;
+    }
+}
+
+static int _is_status_read(const dac161s997_op_t *op)
+{
+    return op->addr == (DAC161S997_STATUS_REG | DAC161S997_REG_READ);
+}
+
+static void _batch_tail(dac161s997_ctx_t *ctx, dac161s997_op_t *ops,
+                        size_t n)
+{
+    dac161s997_op_t *last = &ops[n - 1];
+
+    /* Taken as written until an echo says otherwise */
+    last->err = 0;
+    dac161s997_shadow_update(ctx, last);
+    if (ctx->verify.policy == DAC161S997_VERIFY_LAZY) {
+        dac161s997_encode_frame(ctx->verify.pending, last->addr, last->data);
+    }
+}
+
+static void _verify_pending(dac161s997_ctx_t *ctx, const uint8_t *rx_buf,
+                            int err)
+{
+    dac161s997_op_t op;
 
+    if (!ctx || !ctx->verify.pending[0]) {
+        return;
+    }
+    op.addr = ctx->verify.pending[0];
+    op.data = ((uint16_t)ctx->verify.pending[1] << 8) |
+              ctx->verify.pending[2];
+    ctx->verify.pending[0] = 0;
     if (err) {
+        /* The echo is lost, the write may or may not have landed */
+        op.err = err;
+        dac161s997_shadow_update(ctx, &op);
+        return;
+    }
+    if (_decode_frame(rx_buf, &op)) {
+        dac161s997_stats_echo_error(ctx);
+        dac161s997_shadow_update(ctx, &op);
+        ctx->verify.err = op.err;
+    }
+}
+
+static int _verify_result(dac161s997_ctx_t *ctx, int err)
+{
+    int lazy_err;
+
+    if (!ctx || !ctx->verify.err) {
         return err;
     }
+    lazy_err = ctx->verify.err;
+    ctx->verify.err = 0;
+    return err ? err : lazy_err;
+}
+
+static int _decode_frame(const uint8_t *buf, dac161s997_op_t *op)
+{
+    uint16_t data = ((uint16_t)buf[1] << 8) | buf[2];
 
-    out_buf[0] = DAC161S997_NOP_REG;
-    out_buf[1] = 0x00;
-    out_buf[2] = 0x00;
-    err =  dac161s997_spi_xfer(dev, out_buf, in_buf, 3);
+    op->err = 0;
+    if (buf[0] != op->addr) {
+        op->err = -ENOEXEC;
+    }
+    else if (op->addr & DAC161S997_REG_READ) {
+        op->data = data;
+    }
+    else if (data != op->data) {
+        op->err = -ENOEXEC;
+    }
+    return op->err;
+}
+
+static int _async_next_frame(dac161s997_dev_t *dev, dac161s997_ctx_t *ctx)
+{
+    size_t frame = ctx->async.frame;
+
+    if (frame < ctx->async.n) {
+        dac161s997_encode_frame(ctx->async.tx_buf,
+                                ctx->async.ops[frame].addr,
+                                ctx->async.ops[frame].data);
+    }
+    else {
+        dac161s997_encode_frame(ctx->async.tx_buf, DAC161S997_NOP_REG, 0);
+    }
     _inter_packet_delay();
-    if (in_buf[0] != addr) {
-        return -ENOEXEC;
+    return dac161s997_spi_xfer_async(dev, ctx->async.tx_buf,
+                                     ctx->async.rx_buf, _FRAME_SIZE);
+}
+
+void dac161s997_shadow_update(dac161s997_ctx_t *ctx,
+                                  const dac161s997_op_t *op)
+{
+    uint8_t addr = op->addr & (~DAC161S997_REG_READ);
+    uint8_t idx = addr - DAC161S997_SHADOW_FIRST_REG;
+
+    if (!ctx) {
+        return;
     }
-    *data = ((uint16_t)in_buf[1] << 8) | in_buf[2];
-    return err;
+    if (addr == DAC161S997_RESET_REG && !(op->addr & DAC161S997_REG_READ)) {
+        /* Registers are back to their defaults, or in an unknown state */
+        ctx->shadow_valid = 0;
+        ctx->intent_valid = 0;
+        return;
+    }
+    if (addr < DAC161S997_SHADOW_FIRST_REG ||
+        addr > DAC161S997_SHADOW_LAST_REG) {
+        return;
+    }
+    if (!(op->addr & DAC161S997_REG_READ)) {
+        /* Kept whether or not it landed, it is what recovery restores */
+        ctx->intent[idx] = op->data;
+        ctx->intent_valid |= (1 << idx);
+    }
+    if (op->err) {
+        /* A failed write may or may not have landed */
+        if (!(op->addr & DAC161S997_REG_READ)) {
+            ctx->shadow_valid &= ~(1 << idx);
+        }
+        return;
+    }
+    ctx->shadow[idx] = op->data;
+    ctx->shadow_valid |= (1 << idx);
+}
+
+static void _inter_packet_delay(void)
+{
+    uint32_t elapsed;
+
+    if (!dac161s997_timestamp_ns) {
+        /* No way to tell how long it has been, always wait if we can */
+        if (dac161s997_delay_ns) {
+            dac161s997_delay_ns(DAC161S997_MIN_CS_HIGH_NS);
+        }
+        return;
+    }
+
+    /* Back to back traffic with enough code in between needs no wait */
+    elapsed = _since_last_frame();
+    if (elapsed >= DAC161S997_MIN_CS_HIGH_NS) {
+        return;
+    }
+    if (dac161s997_delay_ns) {
+        dac161s997_delay_ns(DAC161S997_MIN_CS_HIGH_NS - elapsed);
+        return;
+    }
+    while (_since_last_frame() < DAC161S997_MIN_CS_HIGH_NS) {}
+}
+
+static uint32_t _since_last_frame(void)
+{
+    /* Wraps the same way as the stored low half */
+    return (uint32_t)dac161s997_timestamp_ns() -
+           __atomic_load_n(&_last_frame_ns, __ATOMIC_RELAXED);
 }
 
-static void _inter_packet_delay()
+static void _frame_end(dac161s997_ctx_t *ctx, const uint8_t *tx_buf,
+                       const uint8_t *rx_buf, int err, size_t frames)
 {
-    /* Simple delay that may not be needed */
-    for (uint32_t i = 0; i < 50; i++) {}
+    uint64_t now = 0;
+
+    dac161s997_stats_frame(ctx, err, frames);
+    if (ctx) {
+        /* Whatever the last frame asked for is what comes back next */
+        ctx->read_in_flight = 0;
+    }
+    if (dac161s997_timestamp_ns) {
+        now = dac161s997_timestamp_ns();
+        __atomic_store_n(&_last_frame_ns, (uint32_t)now, __ATOMIC_RELAXED);
+        if (ctx) {
+            /* Only correct echoes show the device got its frames and
+             * restarted its SPI timeout
+             */
+            ctx->last_frame_ns = (!err && _echoes_ok(ctx, tx_buf, rx_buf,
+                                                     frames)) ? now : 0;
+        }
+    }
+    if (ctx) {
+        if (err) {
+            ctx->last_tx[0] = 0;
+        }
+        else {
+            memcpy(ctx->last_tx, &tx_buf[(frames - 1) * _FRAME_SIZE],
+                   _FRAME_SIZE);
+        }
+    }
+    dac161s997_trace_frames(ctx, tx_buf, rx_buf, frames, err, now);
+}
+
+static int _echoes_ok(const dac161s997_ctx_t *ctx, const uint8_t *tx_buf,
+                      const uint8_t *rx_buf, size_t frames)
+{
+    for (size_t i = 0; i < frames; i++) {
+        const uint8_t *sent = i ? &tx_buf[(i - 1) * _FRAME_SIZE] :
+                                  ctx->last_tx;
+        const uint8_t *echo = &rx_buf[i * _FRAME_SIZE];
+
+        /* Unknown after a failed transfer, or no frame sent yet */
+        if (!sent[0] || echo[0] != sent[0]) {
+            return 0;
+        }
+        /* A read echoes its address followed by the register */
+        if (!(sent[0] & DAC161S997_REG_READ) &&
+            (echo[1] != sent[1] || echo[2] != sent[2])) {
+            return 0;
+        }
+    }
+    return 1;
 }
@@ -0,0 +1,228 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include "dac161s997.h"
+#include "dac161s997_sched.h"
+
+/* Private defines ************************************************************/
+#define _MASK                   (DAC161S997_SCHED_DEPTH - 1)
+
+#if DAC161S997_SCHED_DEPTH & _MASK
+#error "DAC161S997_SCHED_DEPTH must be a power of two"
+#endif
+
+/* Private functions **********************************************************/
+static uint64_t _due(const dac161s997_sched_t *sched, uint32_t ch);
+
+static void _queue(dac161s997_sched_t *sched, uint32_t ch);
+
+static void _heap_push(dac161s997_sched_t *sched, uint32_t ch);
+
+static void _heap_down(dac161s997_sched_t *sched, size_t pos);
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+void dac161s997_sched_init(dac161s997_sched_t *sched,
+                           dac161s997_sched_chan_t *chans,
+                           dac161s997_dev_t *const *devs, size_t n,
+                           uint64_t late_ns)
+{
+    memset(chans, 0, n * sizeof(*chans));
+    for (size_t i = 0; i < n; i++) {
+        chans[i].dev = devs[i];
+    }
+    sched->chans = chans;
+    sched->n = n;
+    sched->n_heap = 0;
+    sched->n_todo = 0;
+    sched->start_ns = 0;
+    sched->late_ns = late_ns;
+    memset(&sched->stats, 0, sizeof(sched->stats));
+}
+
+int dac161s997_sched_feed(dac161s997_sched_t *sched, size_t ch,
+                          const uint64_t *ts_ns, const int32_t *n_amps,
+                          size_t n)
+{
+    dac161s997_sched_chan_t *chan;
+
+    if (ch >= sched->n) {
+        return -EINVAL;
+    }
+    chan = &sched->chans[ch];
+    if (chan->pos < chan->n) {
+        return -EBUSY;
+    }
+    chan->ts_ns = ts_ns;
+    chan->n_amps = n_amps;
+    chan->n = n;
+    chan->pos = 0;
+    _queue(sched, (uint32_t)ch);
+    return 0;
+}
+
+int dac161s997_sched_hungry(const dac161s997_sched_t *sched, size_t ch)
+{
+    return ch < sched->n && sched->chans[ch].pos >= sched->chans[ch].n;
+}
+
+size_t dac161s997_sched_convert(dac161s997_sched_t *sched)
+{
+    size_t hungry = 0;
+
+    while (sched->n_todo) {
+        uint32_t ch = sched->chans[--sched->n_todo].todo;
+        dac161s997_sched_chan_t *chan = &sched->chans[ch];
+        int was_empty = (chan->head == chan->tail);
+
+        while (chan->pos < chan->n &&
+               chan->head - chan->tail < DAC161S997_SCHED_DEPTH) {
+            int32_t n_amps = chan->n_amps[chan->pos];
+
+            if (!dac161s997_na_valid(n_amps)) {
+                sched->stats.invalid++;
+            }
+            else {
+                chan->due_ns[chan->head & _MASK] = chan->ts_ns[chan->pos];
+                chan->codes[chan->head & _MASK] = dac161s997_na_to_code(n_amps);
+                chan->head++;
+            }
+            chan->pos++;
+        }
+        chan->queued = 0;
+        if (was_empty && chan->head != chan->tail) {
+            _heap_push(sched, ch);
+        }
+        hungry += (chan->pos >= chan->n);
+    }
+    return hungry;
+}
+
+uint64_t dac161s997_sched_next_due(const dac161s997_sched_t *sched)
+{
+    if (!sched->n_heap) {
+        return UINT64_MAX;
+    }
+    return sched->start_ns + _due(sched, sched->chans[0].heap);
+}
+
+int dac161s997_sched_dispatch(dac161s997_sched_t *sched, uint64_t now_ns)
+{
+    int err;
+    int first_err = 0;
+    uint64_t t;
+    dac161s997_sched_stats_t *stats = &sched->stats;
+
+    if (now_ns < sched->start_ns) {
+        return 0;
+    }
+    t = now_ns - sched->start_ns;
+
+    while (sched->n_heap && _due(sched, sched->chans[0].heap) <= t) {
+        uint32_t ch = sched->chans[0].heap;
+        dac161s997_sched_chan_t *chan = &sched->chans[ch];
+        uint32_t last = chan->tail;
+        uint64_t late;
+
+        /* Only the latest due sample matters, the output is a level */
+        while (last + 1 != chan->head && chan->due_ns[(last + 1) & _MASK] <= t) {
+            last++;
+        }
+        stats->skipped += last - chan->tail;
+        chan->tail = last + 1;
+        if (chan->head == chan->tail) {
+            sched->chans[0].heap = sched->chans[--sched->n_heap].heap;
+        }
+        _heap_down(sched, 0);
+        _queue(sched, ch);
+
+        err = dac161s997_set_code(chan->dev, chan->codes[last & _MASK]);
+        if (err) {
+            stats->failed++;
+            if (!first_err) {
+                first_err = err;
+            }
+            continue;
+        }
+
+        /* Only written samples count as sent and for the delays */
+        late = t - chan->due_ns[last & _MASK];
+        stats->late_sum_ns += late;
+        if (late > stats->late_max_ns) {
+            stats->late_max_ns = late;
+        }
+        stats->late += (late > sched->late_ns);
+        stats->sent++;
+    }
+    return first_err;
+}
+
+static uint64_t _due(const dac161s997_sched_t *sched, uint32_t ch)
+{
+    const dac161s997_sched_chan_t *chan = &sched->chans[ch];
+
+    return chan->due_ns[chan->tail & _MASK];
+}
+
+static void _queue(dac161s997_sched_t *sched, uint32_t ch)
+{
+    if (!sched->chans[ch].queued) {
+        sched->chans[ch].queued = 1;
+        sched->chans[sched->n_todo++].todo = ch;
+    }
+}
+
+static void _heap_push(dac161s997_sched_t *sched, uint32_t ch)
+{
+    dac161s997_sched_chan_t *chans = sched->chans;
+    size_t pos = sched->n_heap++;
+    uint64_t due = _due(sched, ch);
+
+    while (pos && _due(sched, chans[(pos - 1) / 2].heap) > due) {
+        chans[pos].heap = chans[(pos - 1) / 2].heap;
+        pos = (pos - 1) / 2;
+    }
+    chans[pos].heap = ch;
+}
+
+static void _heap_down(dac161s997_sched_t *sched, size_t pos)
+{
+    dac161s997_sched_chan_t *chans = sched->chans;
+    uint32_t ch;
+    uint64_t due;
+
+    if (pos >= sched->n_heap) {
+        return;
+    }
+    ch = chans[pos].heap;
+    due = _due(sched, ch);
+    for (;;) {
+        size_t child = 2 * pos + 1;
+
+        if (child >= sched->n_heap) {
+            break;
+        }
+        if (child + 1 < sched->n_heap &&
+            _due(sched, chans[child + 1].heap) < _due(sched, chans[child].heap)) {
+            child++;
+        }
+        if (_due(sched, chans[child].heap) >= due) {
+            break;
+        }
+        chans[pos].heap = chans[child].heap;
+        pos = child;
+    }
+    chans[pos].heap = ch;
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+
+#include "dac161s997.h"
+#include "dac161s997_port.h"
+#include "internal/dac161s997_regs.h"
+#include "internal/dac161s997_stats.h"
+
+#if DAC161S997_STATS
+/* Private functions **********************************************************/
+/*
+ * The counters are guarded by a sequence count. The driver is the only
+ * writer of a device, it makes the count odd while updating, readers retry
+ * until they copied everything under the same even count.
+ */
+static void _write_begin(dac161s997_stats_t *stats);
+
+static void _write_end(dac161s997_stats_t *stats);
+
+static void _inc(uint32_t *counter);
+
+static uint32_t _load(const uint32_t *counter);
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+int dac161s997_stats_get(dac161s997_dev_t *dev, dac161s997_stats_t *stats)
+{
+    const dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+    const dac161s997_stats_t *src;
+    uint32_t seq;
+
+    if (!ctx) {
+        return -ENOTSUP;
+    }
+    src = &ctx->stats;
+    do {
+        seq = __atomic_load_n(&src->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        stats->frames = _load(&src->frames);
+        stats->echo_errors = _load(&src->echo_errors);
+        stats->port_errors = _load(&src->port_errors);
+        stats->retries = _load(&src->retries);
+        stats->skipped_writes = _load(&src->skipped_writes);
+        for (size_t op = 0; op < DAC161S997_STATS_OPS; op++) {
+            for (size_t b = 0; b < DAC161S997_STATS_BUCKETS; b++) {
+                stats->latency[op][b] = _load(&src->latency[op][b]);
+            }
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || __atomic_load_n(&src->seq, __ATOMIC_RELAXED) != seq);
+    stats->seq = seq;
+    return 0;
+}
+
+void dac161s997_stats_frame(dac161s997_ctx_t *ctx, int err, size_t n)
+{
+    uint32_t *counter;
+
+    if (!ctx) {
+        return;
+    }
+    counter = err ? &ctx->stats.port_errors : &ctx->stats.frames;
+    _write_begin(&ctx->stats);
+    __atomic_store_n(counter, *counter + (uint32_t)n, __ATOMIC_RELAXED);
+    _write_end(&ctx->stats);
+}
+
+void dac161s997_stats_echo_error(dac161s997_ctx_t *ctx)
+{
+    if (!ctx) {
+        return;
+    }
+    _write_begin(&ctx->stats);
+    _inc(&ctx->stats.echo_errors);
+    _write_end(&ctx->stats);
+}
+
+void dac161s997_stats_retry(dac161s997_ctx_t *ctx)
+{
+    if (!ctx) {
+        return;
+    }
+    _write_begin(&ctx->stats);
+    _inc(&ctx->stats.retries);
+    _write_end(&ctx->stats);
+}
+
+void dac161s997_stats_skipped_write(dac161s997_ctx_t *ctx)
+{
+    if (!ctx) {
+        return;
+    }
+    _write_begin(&ctx->stats);
+    _inc(&ctx->stats.skipped_writes);
+    _write_end(&ctx->stats);
+}
+
+uint64_t dac161s997_stats_start(void)
+{
+    return dac161s997_timestamp_ns ? dac161s997_timestamp_ns() : 0;
+}
+
+void dac161s997_stats_latency(dac161s997_ctx_t *ctx, unsigned op,
+                              uint64_t start)
+{
+    uint64_t ns;
+    unsigned bucket;
+
+    if (!ctx || !start) {
+        return;
+    }
+    ns = dac161s997_timestamp_ns() - start;
+    bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+    if (bucket >= DAC161S997_STATS_BUCKETS) {
+        bucket = DAC161S997_STATS_BUCKETS - 1;
+    }
+    _write_begin(&ctx->stats);
+    _inc(&ctx->stats.latency[op][bucket]);
+    _write_end(&ctx->stats);
+}
+
+static void _write_begin(dac161s997_stats_t *stats)
+{
+    __atomic_store_n(&stats->seq, stats->seq + 1, __ATOMIC_RELAXED);
+    /* The odd count must be visible before any of the counters change */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void _write_end(dac161s997_stats_t *stats)
+{
+    __atomic_store_n(&stats->seq, stats->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void _inc(uint32_t *counter)
+{
+    __atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+}
+
+static uint32_t _load(const uint32_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+#else
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+int dac161s997_stats_get(dac161s997_dev_t *dev, dac161s997_stats_t *stats)
+{
+    (void)dev;
+    (void)stats;
+    return -ENOTSUP;
+}
+#endif
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include "dac161s997.h"
+#include "dac161s997_port.h"
+#include "dac161s997_trace.h"
+#include "internal/dac161s997_regs.h"
+#include "internal/dac161s997_trace_hooks.h"
+
+/* Private defines ************************************************************/
+#define _FRAME_SIZE             DAC161S997_FRAME_SIZE
+
+/* Private functions **********************************************************/
+/*
+ * The driver is the only writer of head and the reader the only writer of
+ * tail. A record is filled before head is released past it, and a slot is
+ * only reused once tail has been released past it.
+ */
+static void _put(dac161s997_trace_t *trace, const dac161s997_trace_rec_t *rec);
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+int dac161s997_trace_init(dac161s997_trace_t *trace,
+                          dac161s997_trace_rec_t *recs, uint32_t n)
+{
+    if (n == 0 || (n & (n - 1))) {
+        return -EINVAL;
+    }
+    trace->recs = recs;
+    trace->mask = n - 1;
+    trace->head = 0;
+    trace->tail = 0;
+    trace->dropped = 0;
+    return 0;
+}
+
+int dac161s997_trace_attach(dac161s997_dev_t *dev, dac161s997_trace_t *trace,
+                            uint16_t id)
+{
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    if (id > DAC161S997_TRACE_DEV_MASK) {
+        return -EINVAL;
+    }
+    if (!ctx) {
+        return -ENOTSUP;
+    }
+    ctx->trace_id = id;
+    ctx->trace = trace;
+    return 0;
+}
+
+size_t dac161s997_trace_read(dac161s997_trace_t *trace,
+                             dac161s997_trace_rec_t *recs, size_t n)
+{
+    uint32_t tail = trace->tail;
+    uint32_t head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+    size_t count = head - tail;
+
+    if (count > n) {
+        count = n;
+    }
+    for (size_t i = 0; i < count; i++) {
+        recs[i] = trace->recs[(tail + i) & trace->mask];
+    }
+    __atomic_store_n(&trace->tail, tail + (uint32_t)count, __ATOMIC_RELEASE);
+    return count;
+}
+
+void dac161s997_trace_hdr(dac161s997_trace_hdr_t *hdr)
+{
+    memcpy(hdr->magic, DAC161S997_TRACE_MAGIC, sizeof(hdr->magic));
+    hdr->version = DAC161S997_TRACE_VERSION;
+    hdr->rec_size = sizeof(dac161s997_trace_rec_t);
+}
+
+void dac161s997_trace_put_call(dac161s997_ctx_t *ctx,
+                               DAC161S997_TRACE_CALL_t call, size_t n)
+{
+    dac161s997_trace_rec_t rec = {
+        .ts_ns = dac161s997_timestamp_ns ? dac161s997_timestamp_ns() : 0,
+        .dev = (uint16_t)(ctx->trace_id | DAC161S997_TRACE_CALL),
+        .tx = { (uint8_t)call, (uint8_t)(n >> 8), (uint8_t)n },
+    };
+
+    _put(ctx->trace, &rec);
+}
+
+void dac161s997_trace_put_frames(dac161s997_ctx_t *ctx, const uint8_t *tx_buf,
+                                 const uint8_t *rx_buf, size_t n, int err,
+                                 uint64_t ts_ns)
+{
+    dac161s997_trace_rec_t rec = {
+        .ts_ns = ts_ns,
+        .dev = (uint16_t)(ctx->trace_id | (err ? DAC161S997_TRACE_ERR : 0)),
+    };
+
+    for (size_t i = 0; i < n; i++) {
+        memcpy(rec.tx, &tx_buf[i * _FRAME_SIZE], _FRAME_SIZE);
+        memcpy(rec.rx, &rx_buf[i * _FRAME_SIZE], _FRAME_SIZE);
+        _put(ctx->trace, &rec);
+    }
+}
+
+static void _put(dac161s997_trace_t *trace, const dac161s997_trace_rec_t *rec)
+{
+    uint32_t head = trace->head;
+    uint32_t tail = __atomic_load_n(&trace->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail > trace->mask) {
+        __atomic_fetch_add(&trace->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    trace->recs[head & trace->mask] = *rec;
+    __atomic_store_n(&trace->head, head + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include "dac161s997.h"
+#include "dac161s997_wave.h"
+#include "internal/dac161s997_regs.h"
+#include "internal/dac161s997_stats.h"
+#include "internal/dac161s997_trace_hooks.h"
+
+/* Private functions **********************************************************/
+static int _check_na(int32_t n_amps);
+
+static void _append(dac161s997_dev_t *dev, dac161s997_wave_t *wave,
+                    int32_t n_amps);
+
+static int _append_bulk(dac161s997_dev_t *dev, dac161s997_wave_t *wave,
+                        const int32_t *samples_na, size_t n);
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+void dac161s997_wave_init(dac161s997_wave_t *wave, uint8_t *buf, size_t size)
+{
+    wave->frames = buf;
+    wave->len = 0;
+    wave->max = size / DAC161S997_FRAME_SIZE;
+    wave->pos = 0;
+}
+
+int dac161s997_wave_ramp(dac161s997_dev_t *dev, dac161s997_wave_t *wave,
+                         int32_t from_na, int32_t to_na, uint32_t slew_na)
+{
+    uint32_t span;
+    size_t n;
+
+    if (_check_na(from_na) || _check_na(to_na) || !slew_na) {
+        return -EINVAL;
+    }
+    span = (from_na < to_na) ? (uint32_t)(to_na - from_na) :
+                               (uint32_t)(from_na - to_na);
+    n = span / slew_na + ((span % slew_na) ? 1 : 0) + 1;
+    if (n > wave->max - wave->len) {
+        return -ENOBUFS;
+    }
+
+    for (size_t i = 0; i < n - 1; i++) {
+        int64_t step = (int64_t)slew_na * i;
+
+        _append(dev, wave, (from_na < to_na) ? from_na + step : from_na - step);
+    }
+    _append(dev, wave, to_na);
+    return 0;
+}
+
+int dac161s997_wave_steps(dac161s997_dev_t *dev, dac161s997_wave_t *wave,
+                          const int32_t *levels_na, const uint32_t *ticks,
+                          size_t n)
+{
+    size_t total = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (_check_na(levels_na[i])) {
+            return -EINVAL;
+        }
+        total += ticks[i];
+    }
+    if (total > wave->max - wave->len) {
+        return -ENOBUFS;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        size_t first = wave->len;
+
+        if (!ticks[i]) {
+            continue;
+        }
+        /* Encode once, repeat the frame for the rest of the step */
+        _append(dev, wave, levels_na[i]);
+        for (uint32_t t = 1; t < ticks[i]; t++) {
+            memcpy(&wave->frames[wave->len * DAC161S997_FRAME_SIZE],
+                   &wave->frames[first * DAC161S997_FRAME_SIZE],
+                   DAC161S997_FRAME_SIZE);
+            wave->len++;
+        }
+    }
+    return 0;
+}
+
+int dac161s997_wave_samples(dac161s997_dev_t *dev, dac161s997_wave_t *wave,
+                            const int32_t *samples_na, size_t n)
+{
+    if (n > wave->max - wave->len) {
+        /* Out of range samples take precedence, as in the other builders */
+        for (size_t i = 0; i < n; i++) {
+            if (_check_na(samples_na[i])) {
+                return -EINVAL;
+            }
+        }
+        return -ENOBUFS;
+    }
+    /* Checks the samples while encoding them */
+    return _append_bulk(dev, wave, samples_na, n);
+}
+
+void dac161s997_wave_rewind(dac161s997_wave_t *wave)
+{
+    wave->pos = 0;
+}
+
+int dac161s997_wave_tick(dac161s997_dev_t *dev, dac161s997_wave_t *wave)
+{
+    int err;
+    uint8_t *frame;
+    dac161s997_op_t in_flight;
+
+    if (wave->pos >= wave->len) {
+        return -ENODATA;
+    }
+
+    frame = &wave->frames[wave->pos * DAC161S997_FRAME_SIZE];
+    /* The output is in flight until a later frame echoes it back */
+    in_flight.addr = DAC161S997_DACCODE_REG;
+    in_flight.data = ((uint16_t)frame[1] << 8) | frame[2];
+    in_flight.err = -EINPROGRESS;
+    dac161s997_shadow_update(dac161s997_ctx(dev), &in_flight);
+    dac161s997_trace_call(dac161s997_ctx(dev), DAC161S997_TRACE_CALL_FRAME, 1);
+    err = dac161s997_xfer_frame(dev, frame, wave->rx_buf);
+    if (err) {
+        return err;
+    }
+    wave->pos++;
+
+    if (wave->pos > 1 &&
+        memcmp(wave->rx_buf, frame - DAC161S997_FRAME_SIZE,
+               DAC161S997_FRAME_SIZE)) {
+        dac161s997_stats_echo_error(dac161s997_ctx(dev));
+        return -ENOEXEC;
+    }
+    return 0;
+}
+
+static int _check_na(int32_t n_amps)
+{
+    if (!dac161s997_na_valid(n_amps)) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static void _append(dac161s997_dev_t *dev, dac161s997_wave_t *wave,
+                    int32_t n_amps)
+{
+    uint16_t code = dac161s997_cal_code(dev, dac161s997_na_to_code(n_amps));
+
+    dac161s997_encode_frame(&wave->frames[wave->len * DAC161S997_FRAME_SIZE],
+                            DAC161S997_DACCODE_REG, code);
+    wave->len++;
+}
+
+static int _append_bulk(dac161s997_dev_t *dev, dac161s997_wave_t *wave,
+                        const int32_t *samples_na, size_t n)
+{
+    uint8_t *frames = &wave->frames[wave->len * DAC161S997_FRAME_SIZE];
+    dac161s997_ctx_t *ctx = dac161s997_ctx(dev);
+
+    /* Encoded past the end, only counted once every sample is in range */
+    for (size_t base = 0; base < n; base += 32) {
+        size_t count = (n - base < 32) ? n - base : 32;
+        uint32_t err_map;
+
+        if (dac161s997_na_to_frames(&samples_na[base],
+                                    &frames[base * DAC161S997_FRAME_SIZE],
+                                    count, &err_map)) {
+            return -EINVAL;
+        }
+    }
+    if (ctx && ctx->cal) {
+        for (size_t i = 0; i < n; i++) {
+            uint8_t *frame = &frames[i * DAC161S997_FRAME_SIZE];
+            uint16_t code = (uint16_t)((frame[1] << 8) | frame[2]);
+
+            dac161s997_encode_frame(frame, DAC161S997_DACCODE_REG,
+                                    dac161s997_cal_apply(ctx->cal, code));
+        }
+    }
+    wave->len += n;
+    return 0;
+}
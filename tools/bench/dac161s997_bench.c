@@ -0,0 +1,444 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/**
+ ******************************************************************************
+ * @file            dac161s997_bench.c
+ * @author          Kevin Weiss
+ * @brief           Benchmark of the driver against the emulator
+ *
+ * Runs each scenario on emulated chips and prints one tab separated line per
+ * scenario with the SPI frames, bytes and port calls, and the CPU time spent
+ * per operation. Frames are counted by the emulated chips, calls and bytes by
+ * the port, time on the host clock.
+ *
+ * Usage: dac161s997_bench [-n ops] [-b baseline] [-t tolerance_%] [-c]
+ *
+ * With a baseline, any scenario using more frames, bytes or calls per op, or
+ * more than the tolerance of extra time (not with -c), is reported and the
+ * exit code is 1. The output of a run is a valid baseline.
+ ******************************************************************************
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dac161s997.h"
+#include "dac161s997_mailbox.h"
+#include "dac161s997_sched.h"
+#include "dac161s997_emu.h"
+#include "dac161s997_emu_port.h"
+
+/* Private defines ************************************************************/
+#define _MAX_DEVS           256
+#define _DEFAULT_OPS        200000
+#define _DEFAULT_TOLERANCE  25.0
+#define _MAX_NAME           32
+#define _MAX_RESULTS        32
+#define _POLL_NS            10000000    /* Keepalive poll rate of 100 Hz */
+
+/* Private typedefs ***********************************************************/
+typedef struct {
+    char name[_MAX_NAME];
+    double frames;
+    double bytes;
+    double calls;
+    double ns;
+} _result_t;
+
+typedef struct {
+    const char *name;
+    size_t n_devs;
+    /* Runs iteration i of the scenario, returns the number of ops done */
+    size_t (*run)(size_t n_devs, size_t i);
+} _scenario_t;
+
+/* Private variables **********************************************************/
+static dac161s997_dev_t _devs[_MAX_DEVS];
+static dac161s997_dev_t *_dev_ptrs[_MAX_DEVS];
+static int32_t _setpoints[_MAX_DEVS];
+static uint32_t _err_map[DAC161S997_ERR_MAP_WORDS(_MAX_DEVS)];
+static dac161s997_slot_t _slot;
+static dac161s997_keepalive_t _ka;
+static dac161s997_sched_t _sched;
+static dac161s997_sched_chan_t _chans[_MAX_DEVS];
+static uint64_t _sample_ts[_MAX_DEVS];
+static volatile int _sink;
+
+/* Private functions **********************************************************/
+static size_t _run_init(size_t n_devs, size_t i)
+{
+    (void)n_devs;
+    (void)i;
+    _sink += dac161s997_init(&_devs[0]);
+    return 1;
+}
+
+static size_t _run_init_warm(size_t n_devs, size_t i)
+{
+    (void)n_devs;
+    (void)i;
+    _sink += dac161s997_init_warm(&_devs[0]);
+    return 1;
+}
+
+static size_t _run_recover(size_t n_devs, size_t i)
+{
+    (void)n_devs;
+    (void)i;
+    _sink += dac161s997_recover(&_devs[0]);
+    return 1;
+}
+
+static size_t _run_recover_daccode(size_t n_devs, size_t i)
+{
+    (void)n_devs;
+    (void)i;
+    /* DACCODE got corrupted behind the driver's back */
+    _devs[0].emu.regs[DAC161S997_DACCODE_REG] ^= 0x0100;
+    _sink += dac161s997_recover(&_devs[0]);
+    return 1;
+}
+
+static size_t _run_set_output(size_t n_devs, size_t i)
+{
+    (void)n_devs;
+    _sink += dac161s997_set_output(&_devs[0], (i & 1) ? 12000000 : 8000000);
+    return 1;
+}
+
+static size_t _run_set_output_same(size_t n_devs, size_t i)
+{
+    (void)n_devs;
+    (void)i;
+    _sink += dac161s997_set_output(&_devs[0], 12000000);
+    return 1;
+}
+
+static size_t _run_set_output_lazy(size_t n_devs, size_t i)
+{
+    if (i == 0) {
+        dac161s997_set_verify(&_devs[0], DAC161S997_VERIFY_LAZY, 0, 0);
+    }
+    return _run_set_output(n_devs, i);
+}
+
+static size_t _run_set_alarm(size_t n_devs, size_t i)
+{
+    (void)n_devs;
+    _sink += dac161s997_set_alarm(&_devs[0],
+                                  (i & 1) ? DAC161S997_ALARM_HIGH_FAIL :
+                                            DAC161S997_ALARM_LOW_FAIL);
+    return 1;
+}
+
+static size_t _run_get_status(size_t n_devs, size_t i)
+{
+    uint32_t status;
+
+    (void)n_devs;
+    (void)i;
+    _sink += dac161s997_get_status(&_devs[0], &status);
+    return 1;
+}
+
+static size_t _run_get_status_fast(size_t n_devs, size_t i)
+{
+    uint32_t status;
+
+    (void)n_devs;
+    (void)i;
+    _sink += dac161s997_get_status_fast(&_devs[0], &status);
+    return 1;
+}
+
+static size_t _run_get_status_audit_16(size_t n_devs, size_t i)
+{
+    if (i == 0) {
+        dac161s997_set_audit(&_devs[0], 16);
+    }
+    return _run_get_status_fast(n_devs, i);
+}
+
+static size_t _run_slot_flush_4(size_t n_devs, size_t i)
+{
+    (void)n_devs;
+    if (i == 0) {
+        dac161s997_slot_init(&_slot);
+    }
+    /* Four interrupt ticks per flush, only the last one goes out */
+    for (int32_t tick = 0; tick < 4; tick++) {
+        _sink += dac161s997_slot_post(&_slot, ((i & 1) ? 12000000 : 8000000) +
+                                              tick * 1000);
+    }
+    _sink += dac161s997_slot_flush(&_devs[0], &_slot);
+    return 1;
+}
+
+static size_t _run_slot_flush_full(size_t n_devs, size_t i)
+{
+    int32_t n_amps = (i & 1) ? 12000000 : (int32_t)DAC161S997_MAX_NA;
+
+    (void)n_devs;
+    if (i == 0) {
+        dac161s997_slot_init(&_slot);
+    }
+    /* Every other post is full scale, setting the same current again must
+     * find the code already on the device and send nothing */
+    _sink += dac161s997_slot_post(&_slot, n_amps);
+    _sink += dac161s997_slot_flush(&_devs[0], &_slot);
+    _sink += dac161s997_set_output(&_devs[0], n_amps);
+    return 1;
+}
+
+static size_t _run_fleet_set_outputs(size_t n_devs, size_t i)
+{
+    for (size_t d = 0; d < n_devs; d++) {
+        _setpoints[d] = 4000000 + (int32_t)((i + d) % 16) * 1000000;
+    }
+    _sink += dac161s997_set_outputs(_dev_ptrs, _setpoints, n_devs, _err_map);
+    return n_devs;
+}
+
+static size_t _run_fleet_set_outputs_sync(size_t n_devs, size_t i)
+{
+    for (size_t d = 0; d < n_devs; d++) {
+        _setpoints[d] = 4000000 + (int32_t)((i + d) % 16) * 1000000;
+    }
+    _sink += dac161s997_set_outputs_sync(_dev_ptrs, _setpoints, n_devs,
+                                         _err_map);
+    return n_devs;
+}
+
+static size_t _run_fleet_keepalive(size_t n_devs, size_t i)
+{
+    (void)n_devs;
+    (void)i;
+    dac161s997_emu_port_advance(_POLL_NS);
+    _sink += dac161s997_keepalive_poll(&_ka);
+    return 1;
+}
+
+static size_t _run_fleet_keepalive_spread(size_t n_devs, size_t i)
+{
+    if (i == 0) {
+        /* Written together in _setup(), due together without a limit */
+        dac161s997_keepalive_init(&_ka, _dev_ptrs, n_devs, 8);
+    }
+    return _run_fleet_keepalive(n_devs, i);
+}
+
+static size_t _run_fleet_sched(size_t n_devs, size_t i)
+{
+    /* One sample per channel and tick, as a schedule file would feed them */
+    for (size_t d = 0; d < n_devs; d++) {
+        _sample_ts[d] = i;
+        _setpoints[d] = 4000000 + (int32_t)((i + d) % 16) * 1000000;
+        dac161s997_sched_feed(&_sched, d, &_sample_ts[d], &_setpoints[d], 1);
+    }
+    dac161s997_sched_convert(&_sched);
+    _sink += dac161s997_sched_dispatch(&_sched, i);
+    return n_devs;
+}
+
+static void _setup(size_t n_devs)
+{
+    for (size_t d = 0; d < n_devs; d++) {
+        dac161s997_emu_port_init(&_devs[d], d + 1);
+        _dev_ptrs[d] = &_devs[d];
+        dac161s997_init(&_devs[d]);
+        dac161s997_set_output(&_devs[d], 12000000);
+    }
+    dac161s997_keepalive_init(&_ka, _dev_ptrs, n_devs, 0);
+    dac161s997_sched_init(&_sched, _chans, _dev_ptrs, n_devs, 0);
+}
+
+static void _counters(size_t n_devs, uint64_t *frames, uint64_t *bytes,
+                      uint64_t *calls)
+{
+    *frames = *bytes = *calls = 0;
+    for (size_t d = 0; d < n_devs; d++) {
+        *frames += _devs[d].emu.frames;
+        *bytes += _devs[d].xfer_bytes;
+        *calls += _devs[d].xfers;
+    }
+}
+
+static uint64_t _host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void _run(const _scenario_t *sc, size_t ops, _result_t *res)
+{
+    uint64_t frames0, bytes0, calls0, frames1, bytes1, calls1, t0, t1;
+    size_t done = 0;
+    size_t i = 0;
+
+    _setup(sc->n_devs);
+    /* One warm up iteration so only the steady state is measured */
+    sc->run(sc->n_devs, i++);
+
+    _counters(sc->n_devs, &frames0, &bytes0, &calls0);
+    t0 = _host_ns();
+    while (done < ops) {
+        done += sc->run(sc->n_devs, i++);
+    }
+    t1 = _host_ns();
+    _counters(sc->n_devs, &frames1, &bytes1, &calls1);
+
+    snprintf(res->name, sizeof(res->name), "%s", sc->name);
+    res->frames = (double)(frames1 - frames0) / done;
+    res->bytes = (double)(bytes1 - bytes0) / done;
+    res->calls = (double)(calls1 - calls0) / done;
+    res->ns = (double)(t1 - t0) / done;
+}
+
+static size_t _load_baseline(const char *path, _result_t *base, size_t max)
+{
+    char line[256];
+    size_t n = 0;
+    FILE *f = fopen(path, "r");
+
+    if (!f) {
+        perror(path);
+        exit(2);
+    }
+    while (n < max && fgets(line, sizeof(line), f)) {
+        _result_t *r = &base[n];
+
+        if (line[0] == '#') {
+            continue;
+        }
+        if (sscanf(line, "%31s %lf %lf %lf %lf", r->name, &r->frames,
+                   &r->bytes, &r->calls, &r->ns) == 5) {
+            n++;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+static int _compare(const _result_t *res, const _result_t *base, size_t n_base,
+                    double tolerance, int counts_only)
+{
+    /* Counts are deterministic, only rounding of the printout is allowed */
+    const double eps = 0.0005;
+
+    for (size_t i = 0; i < n_base; i++) {
+        int regressed = 0;
+
+        if (strcmp(res->name, base[i].name)) {
+            continue;
+        }
+        regressed |= res->frames > base[i].frames + eps;
+        regressed |= res->bytes > base[i].bytes + eps;
+        regressed |= res->calls > base[i].calls + eps;
+        if (!counts_only) {
+            regressed |= res->ns > base[i].ns * (1 + tolerance / 100);
+        }
+        if (regressed) {
+            fprintf(stderr, "REGRESSION %s: frames %.3f->%.3f bytes %.3f->%.3f"
+                    " calls %.3f->%.3f ns %.1f->%.1f\n", res->name,
+                    base[i].frames, res->frames, base[i].bytes, res->bytes,
+                    base[i].calls, res->calls, base[i].ns, res->ns);
+        }
+        return regressed;
+    }
+    fprintf(stderr, "NEW %s: not in the baseline\n", res->name);
+    return 0;
+}
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+int main(int argc, char **argv)
+{
+    static const _scenario_t scenarios[] = {
+        { "init", 1, _run_init },
+        { "init_warm", 1, _run_init_warm },
+        { "recover", 1, _run_recover },
+        { "recover_daccode", 1, _run_recover_daccode },
+        { "set_output", 1, _run_set_output },
+        { "set_output_same", 1, _run_set_output_same },
+        { "set_output_lazy", 1, _run_set_output_lazy },
+        { "set_alarm", 1, _run_set_alarm },
+        { "get_status", 1, _run_get_status },
+        { "get_status_fast", 1, _run_get_status_fast },
+        { "get_status_audit_16", 1, _run_get_status_audit_16 },
+        { "slot_flush_4", 1, _run_slot_flush_4 },
+        { "slot_flush_full", 1, _run_slot_flush_full },
+        { "fleet_set_outputs_1", 1, _run_fleet_set_outputs },
+        { "fleet_set_outputs_16", 16, _run_fleet_set_outputs },
+        { "fleet_set_outputs_64", 64, _run_fleet_set_outputs },
+        { "fleet_set_outputs_256", 256, _run_fleet_set_outputs },
+        { "fleet_set_outputs_sync_16", 16, _run_fleet_set_outputs_sync },
+        { "fleet_set_outputs_sync_256", 256, _run_fleet_set_outputs_sync },
+        { "fleet_keepalive_1", 1, _run_fleet_keepalive },
+        { "fleet_keepalive_16", 16, _run_fleet_keepalive },
+        { "fleet_keepalive_64", 64, _run_fleet_keepalive },
+        { "fleet_keepalive_256", 256, _run_fleet_keepalive },
+        { "fleet_keepalive_spread_64", 64, _run_fleet_keepalive_spread },
+        { "fleet_sched_16", 16, _run_fleet_sched },
+        { "fleet_sched_256", 256, _run_fleet_sched },
+    };
+    static _result_t base[_MAX_RESULTS];
+    size_t ops = _DEFAULT_OPS;
+    const char *baseline = NULL;
+    double tolerance = _DEFAULT_TOLERANCE;
+    int counts_only = 0;
+    size_t n_base = 0;
+    int regressed = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:b:t:c")) != -1) {
+        switch (opt) {
+        case 'n':
+            ops = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            baseline = optarg;
+            break;
+        case 't':
+            tolerance = strtod(optarg, NULL);
+            break;
+        case 'c':
+            counts_only = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n ops] [-b baseline] [-t tolerance_%%]"
+                    " [-c]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (baseline) {
+        n_base = _load_baseline(baseline, base, _MAX_RESULTS);
+    }
+
+    printf("# scenario\tframes/op\tbytes/op\tcalls/op\tns/op\n");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        _result_t res;
+
+        _run(&scenarios[i], ops, &res);
+        printf("%s\t%.3f\t%.3f\t%.3f\t%.1f\n", res.name, res.frames, res.bytes,
+               res.calls, res.ns);
+        if (baseline) {
+            regressed |= _compare(&res, base, n_base, tolerance, counts_only);
+        }
+    }
+    return regressed;
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/**
+ ******************************************************************************
+ * @file            dac161s997_conv_check.c
+ * @author          Kevin Weiss
+ * @brief           Checks the bulk conversion kernels against the scalar one
+ *
+ * Every kernel the build and CPU support converts every current from
+ * _SWEEP_MIN_NA to _SWEEP_MAX_NA, the edges of the valid range and random
+ * values at all lengths up to a few words. Codes, error maps and frames
+ * must match dac161s997_na_to_code() and the range check of
+ * dac161s997_set_output() bit for bit. Prints the time per sample of each
+ * kernel and exits with 1 on any mismatch.
+ ******************************************************************************
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "dac161s997.h"
+
+/* Private defines ************************************************************/
+#define _SAMPLES            100000
+#define _MAX_LEN            100
+#define _SWEEP_MIN_NA       (-2000000)
+#define _SWEEP_MAX_NA       26000000
+#define _FRAME_SIZE         3
+#define _CHECK(cond)        _check((cond), #cond, __LINE__)
+
+/* Private variables **********************************************************/
+static const char *const _names[] = {
+    "auto", "scalar", "sse2", "avx2", "neon"
+};
+
+static int32_t _na[_SAMPLES];
+static uint16_t _codes[_SAMPLES];
+static uint8_t _frames[_SAMPLES * _FRAME_SIZE];
+static uint32_t _err_map[DAC161S997_ERR_MAP_WORDS(_SAMPLES)];
+static uint32_t _seed = 1;
+static int _failed;
+
+/* Private functions **********************************************************/
+static void _check(int cond, const char *what, int line)
+{
+    if (!cond) {
+        fprintf(stderr, "line %d: %s failed\n", line, what);
+        _failed = 1;
+    }
+}
+
+static uint32_t _rand(void)
+{
+    /* xorshift32, the same values on every run */
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return _seed;
+}
+
+static void _fill(void)
+{
+    static const int32_t edges[] = {
+        INT32_MIN, INT32_MIN + 1, -1000000, -1, 0, 1, 182, 183, 184,
+        (int32_t)DAC161S997_MIN_NA - 1, (int32_t)DAC161S997_MIN_NA,
+        (int32_t)DAC161S997_MAX_NA, (int32_t)DAC161S997_MAX_NA + 1,
+        23999816, 23999817, 23999818, 24000000, 25000000, INT32_MAX - 1,
+        INT32_MAX
+    };
+    size_t i = 0;
+
+    for (size_t e = 0; e < sizeof(edges) / sizeof(edges[0]); e++) {
+        _na[i++] = edges[e];
+    }
+    /* Coarse sweep from below zero to above full scale */
+    while (i < _SAMPLES / 2) {
+        _na[i] = -1000000 + (int32_t)(i * 521);
+        i++;
+    }
+    /* Random values, half of them near the valid range */
+    while (i < _SAMPLES) {
+        uint32_t r = _rand();
+
+        _na[i++] = (r & 1) ? (int32_t)r : (int32_t)(r % 26000000) - 1000000;
+    }
+}
+
+static int _bad(int32_t na)
+{
+    /* Spelled out rather than dac161s997_na_valid(), which is under test */
+    return (uint32_t)na < DAC161S997_MIN_NA || (uint32_t)na > DAC161S997_MAX_NA;
+}
+
+static int _matches(const int32_t *na, size_t n)
+{
+    size_t bad = 0;
+    size_t ret;
+
+    memset(_err_map, 0xA5, sizeof(_err_map));
+    ret = dac161s997_na_to_codes(na, _codes, n, _err_map);
+    for (size_t i = 0; i < n; i++) {
+        if (_codes[i] != dac161s997_na_to_code(na[i]) ||
+            ((_err_map[i / 32] >> (i % 32)) & 1) != (uint32_t)_bad(na[i])) {
+            return 0;
+        }
+        bad += (size_t)_bad(na[i]);
+    }
+    /* Bits past the end of the last word are cleared */
+    if (n % 32 && _err_map[n / 32] >> (n % 32)) {
+        return 0;
+    }
+    if (ret != bad) {
+        return 0;
+    }
+
+    memset(_frames, 0, n * _FRAME_SIZE);
+    if (dac161s997_na_to_frames(na, _frames, n, _err_map) != bad) {
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint16_t code = dac161s997_na_to_code(na[i]);
+        const uint8_t *frame = &_frames[i * _FRAME_SIZE];
+
+        if (frame[0] != DAC161S997_DACCODE_REG || frame[1] != (code >> 8) ||
+            frame[2] != (code & 0xFF)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int _sweep(void)
+{
+    static int32_t na[_SAMPLES];
+    int32_t next = _SWEEP_MIN_NA;
+
+    /* Every current around the valid range, a buffer at a time */
+    while (next <= _SWEEP_MAX_NA) {
+        size_t n = 0;
+
+        while (n < _SAMPLES && next <= _SWEEP_MAX_NA) {
+            na[n++] = next++;
+        }
+        if (!_matches(na, n)) {
+            fprintf(stderr, "sweep differs from %ld nA\n",
+                    (long)na[0]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static double _ns_per_sample(void)
+{
+    struct timespec start;
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int rep = 0; rep < 10; rep++) {
+        dac161s997_na_to_codes(_na, _codes, _SAMPLES, _err_map);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((double)(end.tv_sec - start.tv_sec) * 1e9 +
+            (double)(end.tv_nsec - start.tv_nsec)) / (10.0 * _SAMPLES);
+}
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+int main(void)
+{
+    _fill();
+    for (int conv = DAC161S997_CONV_SCALAR; conv <= DAC161S997_CONV_NEON;
+         conv++) {
+        if (dac161s997_conv_select((DAC161S997_CONV_t)conv)) {
+            printf("%-8s not supported\n", _names[conv]);
+            continue;
+        }
+        _CHECK(_matches(_na, _SAMPLES));
+        _CHECK(_sweep());
+        /* Every length and alignment of the vector tails */
+        for (size_t off = 0; off < 4; off++) {
+            for (size_t n = 0; n <= _MAX_LEN; n++) {
+                _CHECK(_matches(&_na[off], n));
+                _CHECK(_matches(&_na[_SAMPLES / 2 + off], n));
+            }
+        }
+        printf("%-8s %.2f ns/sample\n", _names[conv], _ns_per_sample());
+    }
+    _CHECK(dac161s997_conv_select(DAC161S997_CONV_AUTO) == 0);
+    _CHECK(_matches(_na, _SAMPLES));
+    _CHECK(dac161s997_conv_select((DAC161S997_CONV_t)42) != 0);
+    return _failed;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/**
+ ******************************************************************************
+ * @file            dac161s997_coro_check.cpp
+ * @author          Kevin Weiss
+ * @brief           Builds and runs the coroutine adapter on the emulated port
+ *
+ * Awaits every request of dac161s997_coro.hpp from one coroutine. The
+ * emulated port completes a transfer before its start call returns, which
+ * is the hardest case for the adapter. Exits with 1 on any mismatch or if
+ * the coroutine did not run to its end.
+ ******************************************************************************
+ */
+
+/* Includes *******************************************************************/
+#include <coroutine>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+
+#include "dac161s997_coro.hpp"
+#include "dac161s997_emu_port.h"
+
+/* Private macros *************************************************************/
+#define _CHECK(cond)        _check((cond), #cond, __LINE__)
+
+namespace {
+
+/* Private typedefs ***********************************************************/
+/* Starts right away and is never awaited itself */
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+/* Private variables **********************************************************/
+dac161s997_dev_t _dev;
+bool _done;
+int _failed;
+
+/* Private functions **********************************************************/
+void _check(bool cond, const char *what, int line)
+{
+    if (!cond) {
+        std::fprintf(stderr, "line %d: %s failed\n", line, what);
+        _failed = 1;
+    }
+}
+
+Task _run(dac161s997_dev_t *dev)
+{
+    uint32_t status = 0;
+
+    _CHECK(co_await dac161s997::init(dev) == 0);
+    _CHECK(co_await dac161s997::set_output(dev, 12000000) == 0);
+    _CHECK(dac161s997_emu_output_na(&dev->emu) - 12000000 < 200 &&
+           12000000 - dac161s997_emu_output_na(&dev->emu) < 200);
+    _CHECK(co_await dac161s997::set_output(dev, 1000000) == -EINVAL);
+    _CHECK(co_await dac161s997::set_alarm(dev, DAC161S997_ALARM_HIGH_FAIL) ==
+           0);
+    _CHECK(co_await dac161s997::get_status(dev, &status) == 0);
+    _CHECK(status == DAC161S997_HI_ALARM_ERR);
+    _done = true;
+}
+
+} /* namespace */
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+int main()
+{
+    dac161s997_emu_port_init(&_dev, 1);
+    _run(&_dev);
+    _CHECK(_done);
+    return _failed;
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/**
+ ******************************************************************************
+ * @file            dac161s997_hpp_check.cpp
+ * @author          Kevin Weiss
+ * @brief           Builds and runs the C++ front end against an emulated chip
+ *
+ * Instantiates every member of dac161s997::Device through DAC161S997_PORT,
+ * so the header is compiled with each build. The default configuration must
+ * leave the registers exactly as dac161s997_init() does, a custom one must
+ * be written on top. Exits with 1 on any mismatch.
+ ******************************************************************************
+ */
+
+/* Includes *******************************************************************/
+#include <array>
+#include <cstdint>
+#include <cstdio>
+
+#include "dac161s997.hpp"
+#include "dac161s997_emu.h"
+
+/* Private macros *************************************************************/
+#define _CHECK(cond)        _check((cond), #cond, __LINE__)
+
+/* Private typedefs ***********************************************************/
+struct dac161s997_dev_t {
+    dac161s997_emu_t emu;
+    dac161s997_ctx_t ctx;
+};
+
+namespace {
+
+struct Emu {
+    static int xfer(dac161s997_dev_t *dev, uint8_t *tx_buf, uint8_t *rx_buf,
+                    size_t size)
+    {
+        dac161s997_emu_xfer(&dev->emu, tx_buf, rx_buf, size);
+        return 0;
+    }
+    static dac161s997_ctx_t *ctx(dac161s997_dev_t *dev) { return &dev->ctx; }
+};
+
+struct Custom : dac161s997::DefaultConfig {
+    static constexpr int32_t alarm_high_na = 22000000;
+    static constexpr uint32_t spi_timeout_ms = 100;
+    static constexpr DAC161S997_VERIFY_t verify = DAC161S997_VERIFY_LAZY;
+};
+
+/* Private variables **********************************************************/
+dac161s997_dev_t _devs[2];
+int _failed;
+
+/* Private functions **********************************************************/
+void _check(bool cond, const char *what, int line)
+{
+    if (!cond) {
+        std::fprintf(stderr, "line %d: %s failed\n", line, what);
+        _failed = 1;
+    }
+}
+
+} /* namespace */
+
+DAC161S997_PORT(Emu)
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+int main()
+{
+    dac161s997::Device<Emu> dev(_devs[0]);
+    dac161s997::Device<Emu, Custom> custom(_devs[1]);
+    const std::array<dac161s997::Device<Emu>, 1> fleet{dev};
+    const std::array<int32_t, 1> n_amps{16000000};
+    std::array<dac161s997_op_t, 1> ops{
+        DAC161S997_OP_READ(DAC161S997_ERR_CONFIG_REG)};
+    uint32_t err_map[DAC161S997_ERR_MAP_WORDS(1)];
+    uint32_t status;
+    const uint16_t *regs = _devs[0].emu.regs;
+
+    dac161s997_emu_init(&_devs[0].emu, 1);
+    dac161s997_emu_init(&_devs[1].emu, 2);
+
+    /* Same registers as the C driver */
+    _CHECK(dev.init() == 0);
+    _CHECK(regs[DAC161S997_ERR_CONFIG_REG] == DAC161S997_INIT_ERR_CONFIG);
+    _CHECK(regs[DAC161S997_ERR_LOW_REG] ==
+           DAC161S997_NA_TO_CODE(DAC161S997_FAIL_LO_ALARM_NA));
+    _CHECK(regs[DAC161S997_ERR_HIGH_REG] ==
+           DAC161S997_NA_TO_CODE(DAC161S997_FAIL_HI_ALARM_NA));
+
+    _CHECK(dev.set_output<12000000>() == 0);
+    _CHECK(regs[DAC161S997_DACCODE_REG] == dac161s997::code_v<12000000>);
+    _CHECK(dev.set_output(8000000) == 0);
+    _CHECK(dev.set_output(1000000) == -EINVAL);
+    _CHECK(dev.set_code(0x1234) == 0);
+    _CHECK(regs[DAC161S997_DACCODE_REG] == 0x1234);
+    _CHECK(dev.set_alarm<DAC161S997_ALARM_HIGH_SAT>() == 0);
+    _CHECK(regs[DAC161S997_DACCODE_REG] ==
+           DAC161S997_NA_TO_CODE(DAC161S997_SAT_HI_ALARM_NA));
+    _CHECK(dev.get_status(status) == 0);
+    _CHECK(dev.audit(status) == 0);
+    _CHECK(dev.recover() == 0);
+    _CHECK(dev.xfer(ops) == 0);
+    _CHECK(ops[0].data == DAC161S997_INIT_ERR_CONFIG);
+    _CHECK(dac161s997::Device<Emu>::set_outputs(fleet, n_amps, err_map) == 0);
+    _CHECK(regs[DAC161S997_DACCODE_REG] == dac161s997::code_v<16000000>);
+
+    /* Only the differences are written after the reset */
+    _CHECK(custom.init() == 0);
+    _CHECK(_devs[1].emu.regs[DAC161S997_ERR_CONFIG_REG] ==
+           DAC161S997_ERR_CONFIG_SPI_TIMEOUT(100));
+    _CHECK(_devs[1].emu.regs[DAC161S997_ERR_HIGH_REG] ==
+           dac161s997::code_v<22000000>);
+    _CHECK(custom.set_alarm<DAC161S997_ALARM_HIGH_FAIL>() == 0);
+    _CHECK(_devs[1].emu.regs[DAC161S997_DACCODE_REG] ==
+           dac161s997::code_v<22000000>);
+    return _failed;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "dac161s997.h"
+#include "dac161s997_emu.h"
+
+/* Private defines ************************************************************/
+#define _FRAME_SIZE             3
+#define _RESET_CODE             0xC33C
+#define _XFR_CODE               0x00FF
+
+#define _STATUS_LOOP_STS        0x0001
+#define _STATUS_SPI_TIMEOUT     0x0004
+#define _STATUS_FERR            0x0008
+
+#define _ERR_CONFIG_MASK_SPI    0x0001
+#define _ERR_CONFIG_TIMEOUT(cfg)    ((((uint64_t)(cfg) >> 1) & 7) + 1)
+#define _TIMEOUT_STEP_NS        50000000ULL
+
+/* Private variables **********************************************************/
+/* Power on values of the registers */
+static const uint16_t _por_regs[DAC161S997_EMU_REGS] = {
+    [DAC161S997_PROTECT_REG_WR_REG] = 0x0000,
+    [DAC161S997_DACCODE_REG] = 0x2AAA,
+    [DAC161S997_ERR_CONFIG_REG] = 0x0102,
+    [DAC161S997_ERR_LOW_REG] = 0x2400,
+    [DAC161S997_ERR_HIGH_REG] = 0xF000,
+};
+
+/* Private functions **********************************************************/
+static void _check_timeout(dac161s997_emu_t *emu);
+
+static void _latch(dac161s997_emu_t *emu, const uint8_t *frame);
+
+static uint32_t _rand(dac161s997_emu_t *emu);
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+void dac161s997_emu_init(dac161s997_emu_t *emu, uint32_t seed)
+{
+    memset(emu, 0, sizeof(*emu));
+    memcpy(emu->regs, _por_regs, sizeof(emu->regs));
+    emu->rng = seed ? seed : 1;
+}
+
+void dac161s997_emu_xfer(dac161s997_emu_t *emu, const uint8_t *tx_buf,
+                         uint8_t *rx_buf, size_t size)
+{
+    if (emu->faults & DAC161S997_EMU_FAULT_ABSENT) {
+        memset(rx_buf, 0xFF, size);
+        return;
+    }
+
+    _check_timeout(emu);
+    if (size != _FRAME_SIZE) {
+        /* Shift whatever is there, only the frame error sticks */
+        for (size_t i = 0; i < size; i++) {
+            rx_buf[i] = emu->shift[i % _FRAME_SIZE];
+        }
+        emu->regs[DAC161S997_STATUS_REG] |= _STATUS_FERR;
+        emu->frame_errors++;
+        return;
+    }
+
+    memcpy(rx_buf, emu->shift, _FRAME_SIZE);
+    if ((emu->faults & DAC161S997_EMU_FAULT_BIT_FLIP) && emu->bit_flip_rate &&
+        _rand(emu) % emu->bit_flip_rate == 0) {
+        uint32_t bit = _rand(emu) % (_FRAME_SIZE * 8);
+
+        rx_buf[bit / 8] ^= 1 << (bit % 8);
+    }
+    _latch(emu, tx_buf);
+}
+
+void dac161s997_emu_advance(dac161s997_emu_t *emu, uint64_t ns)
+{
+    emu->now_ns += ns;
+    _check_timeout(emu);
+}
+
+int32_t dac161s997_emu_output_na(const dac161s997_emu_t *emu)
+{
+    uint16_t code = emu->regs[DAC161S997_DACCODE_REG];
+
+    if (emu->faults & DAC161S997_EMU_FAULT_LOOP_OPEN) {
+        return 0;
+    }
+    if ((emu->regs[DAC161S997_STATUS_REG] & _STATUS_SPI_TIMEOUT) &&
+        !(emu->regs[DAC161S997_ERR_CONFIG_REG] & _ERR_CONFIG_MASK_SPI)) {
+        code = emu->regs[DAC161S997_ERR_LOW_REG];
+    }
+    return (int32_t)(((uint32_t)code * 46875 + 64) >> 7);
+}
+
+static void _check_timeout(dac161s997_emu_t *emu)
+{
+    uint16_t cfg = emu->regs[DAC161S997_ERR_CONFIG_REG];
+    uint64_t timeout = _ERR_CONFIG_TIMEOUT(cfg) * _TIMEOUT_STEP_NS;
+
+    if (emu->faults & DAC161S997_EMU_FAULT_LOOP_OPEN) {
+        emu->regs[DAC161S997_STATUS_REG] |= _STATUS_LOOP_STS;
+    }
+    if (!(emu->regs[DAC161S997_STATUS_REG] & _STATUS_SPI_TIMEOUT) &&
+        emu->now_ns - emu->last_frame_ns > timeout) {
+        emu->regs[DAC161S997_STATUS_REG] |= _STATUS_SPI_TIMEOUT;
+        emu->timeouts++;
+    }
+}
+
+static void _latch(dac161s997_emu_t *emu, const uint8_t *frame)
+{
+    uint8_t addr = frame[0] & ~DAC161S997_REG_READ;
+    uint16_t data = ((uint16_t)frame[1] << 8) | frame[2];
+
+    emu->frames++;
+    emu->last_frame_ns = emu->now_ns;
+    /* The frame itself is echoed unless it asks for a register */
+    memcpy(emu->shift, frame, _FRAME_SIZE);
+
+    if (addr == 0 || addr >= DAC161S997_EMU_REGS) {
+        return;
+    }
+    if (frame[0] & DAC161S997_REG_READ) {
+        emu->shift[1] = emu->regs[addr] >> 8;
+        emu->shift[2] = emu->regs[addr] & 0xFF;
+        if (addr == DAC161S997_STATUS_REG) {
+            /* Reading clears the sticky errors, the loop status is live */
+            emu->regs[addr] = (emu->faults & DAC161S997_EMU_FAULT_LOOP_OPEN) ?
+                              _STATUS_LOOP_STS : 0;
+        }
+        return;
+    }
+
+    switch (addr) {
+    case DAC161S997_XFR_REG:
+        if (data == _XFR_CODE && emu->held_addr) {
+            emu->regs[emu->held_addr] = emu->held_data;
+            emu->held_addr = 0;
+        }
+        break;
+    case DAC161S997_NOP_REG:
+    case DAC161S997_STATUS_REG:
+        break;
+    case DAC161S997_RESET_REG:
+        if (data == _RESET_CODE) {
+            memcpy(emu->regs, _por_regs, sizeof(emu->regs));
+            emu->held_addr = 0;
+        }
+        break;
+    case DAC161S997_PROTECT_REG_WR_REG:
+        emu->regs[addr] = data & 1;
+        break;
+    default:
+        if (emu->regs[DAC161S997_PROTECT_REG_WR_REG]) {
+            emu->held_addr = addr;
+            emu->held_data = data;
+        }
+        else {
+            emu->regs[addr] = data;
+        }
+        break;
+    }
+}
+
+static uint32_t _rand(dac161s997_emu_t *emu)
+{
+    /* xorshift32, good enough to pick bits and frames */
+    emu->rng ^= emu->rng << 13;
+    emu->rng ^= emu->rng >> 17;
+    emu->rng ^= emu->rng << 5;
+    return emu->rng;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/**
+ ******************************************************************************
+ * @addtogroup EMULATOR
+ * @{
+ * @file            dac161s997_emu.h
+ * @author          Kevin Weiss
+ * @brief           Register level emulator of the dac161s997
+ *
+ * Models what the driver can observe through SPI: the register file, the
+ * echo of each frame on the next one, reads, the reset command, protected
+ * writes committed by XFR, the SPI timeout and the STATUS bits. Time is
+ * virtual and only moves when told to, so runs are deterministic.
+ *
+ * Faults can be injected to exercise the error paths of the driver.
+ ******************************************************************************
+ */
+
+#ifndef DAC161S997_EMU_H_
+#define DAC161S997_EMU_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+
+/* Defines ********************************************************************/
+#define DAC161S997_EMU_REGS             10      /**< Register addresses 0x00 to 0x09 */
+
+/**
+ * @defgroup DAC161S997_EMU_FAULT
+ * @{
+ */
+#define DAC161S997_EMU_FAULT_ABSENT     0x01    /**< MISO floats high, nothing is latched */
+#define DAC161S997_EMU_FAULT_LOOP_OPEN  0x02    /**< The current loop is open */
+#define DAC161S997_EMU_FAULT_BIT_FLIP   0x04    /**< Random MISO bit flips, see bit_flip_rate */
+/** @} */
+
+/* Typedefs *******************************************************************/
+typedef struct {
+    uint16_t regs[DAC161S997_EMU_REGS]; /**< Register file */
+    uint16_t held_data;     /**< Write held in protected mode */
+    uint8_t held_addr;      /**< Address of the held write, 0 if none */
+    uint8_t shift[3];       /**< Output shift register, clocked out next frame */
+    uint8_t faults;         /**< Active @ref DAC161S997_EMU_FAULT */
+    uint32_t bit_flip_rate; /**< Frames per flipped MISO bit on average */
+    uint32_t rng;           /**< State of the fault injection generator */
+    uint64_t now_ns;        /**< Virtual time */
+    uint64_t last_frame_ns; /**< Virtual time of the last valid frame */
+    uint64_t frames;        /**< Frames received */
+    uint64_t frame_errors;  /**< Frames with a bad length */
+    uint64_t timeouts;      /**< Times the SPI timeout expired */
+} dac161s997_emu_t;         /**< State of an emulated chip */
+
+/* Function prototypes ********************************************************/
+/**
+ * @brief    Powers up an emulated chip.
+ *
+ * @param[out]  emu         Chip to power up
+ * @param[in]   seed        Seed of the fault injection generator
+ */
+void dac161s997_emu_init(dac161s997_emu_t *emu, uint32_t seed);
+
+/**
+ * @brief    Clocks a chip select cycle through the chip.
+ *
+ * Only whole 24 bit frames are latched, other lengths set the frame error.
+ *
+ * @param[in,out]   emu     Chip selected
+ * @param[in]       tx_buf  Bytes on MOSI
+ * @param[out]      rx_buf  Bytes on MISO
+ * @param[in]       size    Number of bytes clocked
+ */
+void dac161s997_emu_xfer(dac161s997_emu_t *emu, const uint8_t *tx_buf,
+                         uint8_t *rx_buf, size_t size);
+
+/**
+ * @brief    Moves the virtual time of a chip forward.
+ *
+ * @param[in,out]   emu     Chip to advance
+ * @param[in]       ns      Time to advance by
+ */
+void dac161s997_emu_advance(dac161s997_emu_t *emu, uint64_t ns);
+
+/**
+ * @brief    Gets the current the chip drives into the loop.
+ *
+ * @param[in]   emu         Chip to check
+ *
+ * @return      Loop current in nA, the error level while the SPI timeout is
+ *              expired and 0 with an open loop
+ */
+int32_t dac161s997_emu_output_na(const dac161s997_emu_t *emu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DAC161S997_EMU_H_ */
+/** @} */
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include "dac161s997.h"
+#include "dac161s997_port.h"
+#include "dac161s997_emu.h"
+#include "dac161s997_emu_port.h"
+
+/* Private defines ************************************************************/
+#define _BYTE_NS        (8 * 1000000000ULL / DAC161S997_EMU_SCLK_HZ)
+
+/* Private variables **********************************************************/
+/* Starts above 0, the driver takes a 0 timestamp as no timestamp */
+static uint64_t _now_ns = 1;
+
+/* Private functions **********************************************************/
+static int _xfer(dac161s997_dev_t *dev, uint8_t *tx_buf, uint8_t *rx_buf,
+                 size_t size);
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+void dac161s997_emu_port_init(dac161s997_dev_t *dev, uint32_t seed)
+{
+    memset(dev, 0, sizeof(*dev));
+    dac161s997_emu_init(&dev->emu, seed);
+    /* Powered up just now, the SPI timeout runs from here */
+    dev->emu.now_ns = _now_ns;
+    dev->emu.last_frame_ns = _now_ns;
+}
+
+void dac161s997_emu_port_advance(uint64_t ns)
+{
+    _now_ns += ns;
+}
+
+uint64_t dac161s997_emu_port_now(void)
+{
+    return _now_ns;
+}
+
+int dac161s997_spi_xfer(dac161s997_dev_t *dev, uint8_t *tx_buf,
+                        uint8_t *rx_buf, size_t size)
+{
+    return _xfer(dev, tx_buf, rx_buf, size);
+}
+
+int dac161s997_spi_xfer_async(dac161s997_dev_t *dev, uint8_t *tx_buf,
+                              uint8_t *rx_buf, size_t size)
+{
+    int err = _xfer(dev, tx_buf, rx_buf, size);
+
+    /* The emulated transfer is done by now, report it right away */
+    dac161s997_xfer_done(dev, err);
+    return 0;
+}
+
+int dac161s997_spi_xfer_multi(dac161s997_dev_t *const *devs, size_t n,
+                              uint8_t *tx_buf, size_t size)
+{
+    uint8_t rx_buf[3];
+
+    if (size > sizeof(rx_buf)) {
+        return -EINVAL;
+    }
+    /* One port call and one frame time for the whole group */
+    devs[0]->xfers++;
+    for (size_t i = 0; i < n; i++) {
+        int err = devs[i]->xfer_err;
+
+        if (err) {
+            devs[i]->xfer_err = 0;
+            return err;
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        dac161s997_emu_advance(&devs[i]->emu, _now_ns - devs[i]->emu.now_ns);
+        dac161s997_emu_xfer(&devs[i]->emu, tx_buf, rx_buf, size);
+    }
+    devs[0]->xfer_bytes += size;
+    _now_ns += size * _BYTE_NS;
+    return 0;
+}
+
+int dac161s997_spi_xfer_each(dac161s997_dev_t *const *devs, size_t n,
+                             uint8_t *tx_buf, uint8_t *rx_buf, size_t size)
+{
+    /* One port call, the frames follow each other on the bus */
+    devs[0]->xfers++;
+    for (size_t i = 0; i < n; i++) {
+        int err = devs[i]->xfer_err;
+
+        if (err) {
+            devs[i]->xfer_err = 0;
+            return err;
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        dac161s997_emu_advance(&devs[i]->emu, _now_ns - devs[i]->emu.now_ns);
+        dac161s997_emu_xfer(&devs[i]->emu, &tx_buf[i * size],
+                            &rx_buf[i * size], size);
+        devs[i]->xfer_bytes += size;
+        _now_ns += size * _BYTE_NS;
+    }
+    return 0;
+}
+
+dac161s997_ctx_t *dac161s997_get_ctx(dac161s997_dev_t *dev)
+{
+    return &dev->ctx;
+}
+
+uint64_t dac161s997_timestamp_ns(void)
+{
+    return _now_ns;
+}
+
+void dac161s997_delay_ns(uint32_t ns)
+{
+    _now_ns += ns;
+}
+
+static int _xfer(dac161s997_dev_t *dev, uint8_t *tx_buf, uint8_t *rx_buf,
+                 size_t size)
+{
+    int err = dev->xfer_err;
+
+    dev->xfers++;
+    if (err) {
+        dev->xfer_err = 0;
+        return err;
+    }
+    /* Catch the chip up with the time that passed since it was last used */
+    dac161s997_emu_advance(&dev->emu, _now_ns - dev->emu.now_ns);
+    dac161s997_emu_xfer(&dev->emu, tx_buf, rx_buf, size);
+    dev->xfer_bytes += size;
+    _now_ns += size * _BYTE_NS;
+    return 0;
+}
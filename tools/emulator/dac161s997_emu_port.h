@@ -0,0 +1,78 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/**
+ ******************************************************************************
+ * @addtogroup EMULATOR
+ * @{
+ * @file            dac161s997_emu_port.h
+ * @author          Kevin Weiss
+ * @brief           Driver port running on emulated chips
+ *
+ * Implements the port functions on top of @ref dac161s997_emu.h, each device
+ * being one emulated chip. All chips share a virtual clock that moves by the
+ * length of each frame at DAC161S997_EMU_SCLK_HZ and by every delay the
+ * driver asks for, so no real time is spent waiting.
+ ******************************************************************************
+ */
+
+#ifndef DAC161S997_EMU_PORT_H_
+#define DAC161S997_EMU_PORT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include "dac161s997.h"
+#include "dac161s997_emu.h"
+
+/* Defines ********************************************************************/
+#ifndef DAC161S997_EMU_SCLK_HZ
+#define DAC161S997_EMU_SCLK_HZ          10000000    /**< Emulated SPI clock */
+#endif
+
+/* Typedefs *******************************************************************/
+struct dac161s997_dev_t {
+    dac161s997_emu_t emu;   /**< Chip behind the chip select */
+    dac161s997_ctx_t ctx;   /**< Driver context */
+    int xfer_err;           /**< Returned by the next transfer if not 0 */
+    uint64_t xfers;         /**< Calls to the SPI port functions */
+    uint64_t xfer_bytes;    /**< Bytes clocked by those calls */
+};
+
+/* Function prototypes ********************************************************/
+/**
+ * @brief    Powers up the chip of an emulated device.
+ *
+ * @param[out]  dev         Device to set up
+ * @param[in]   seed        Seed of the fault injection generator
+ */
+void dac161s997_emu_port_init(dac161s997_dev_t *dev, uint32_t seed);
+
+/**
+ * @brief    Moves the shared virtual clock forward, as if idle.
+ *
+ * @param[in]   ns          Time to advance by
+ */
+void dac161s997_emu_port_advance(uint64_t ns);
+
+/**
+ * @brief    Gets the shared virtual clock.
+ *
+ * @return   Virtual time in ns
+ */
+uint64_t dac161s997_emu_port_now(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DAC161S997_EMU_PORT_H_ */
+/** @} */
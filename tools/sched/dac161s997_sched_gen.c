@@ -0,0 +1,147 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/**
+ ******************************************************************************
+ * @file            dac161s997_sched_gen.c
+ * @author          Kevin Weiss
+ * @brief           Writes a synthetic schedule file
+ *
+ * Each channel ramps up and down between 4 and 20 mA with its own slope,
+ * sampled every period with the channels spread over the period.
+ *
+ * Usage: dac161s997_sched_gen [-c channels] [-n samples] [-p period_ns] file
+ *
+ * The file grows by 12 bytes per sample and channel, it is written a chunk
+ * at a time so any size can be generated.
+ ******************************************************************************
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dac161s997.h"
+#include "dac161s997_sched.h"
+
+/* Private defines ************************************************************/
+#define _MAX_CHANS          256
+#define _DEFAULT_CHANS      16
+#define _DEFAULT_SAMPLES    100000
+#define _DEFAULT_PERIOD_NS  1000000     /* 1 kHz per channel */
+#define _CHUNK              4096
+#define _SPAN_NA            16000000
+
+/* Private variables **********************************************************/
+static dac161s997_sched_col_t _cols[_MAX_CHANS];
+static uint64_t _ts[_CHUNK];
+static int32_t _na[_CHUNK];
+
+/* Private functions **********************************************************/
+static int32_t _sample(size_t ch, uint64_t i);
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+int main(int argc, char **argv)
+{
+    size_t n_chans = _DEFAULT_CHANS;
+    uint64_t n = _DEFAULT_SAMPLES;
+    uint64_t period = _DEFAULT_PERIOD_NS;
+    uint64_t off;
+    dac161s997_sched_hdr_t hdr;
+    FILE *file;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:n:p:")) != -1) {
+        switch (opt) {
+        case 'c':
+            n_chans = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            n = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            period = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if (optind != argc - 1 || n_chans == 0 || n_chans > _MAX_CHANS ||
+        period == 0) {
+        fprintf(stderr, "usage: %s [-c channels] [-n samples] [-p period_ns]"
+                " file\n", argv[0]);
+        return 2;
+    }
+    file = fopen(argv[optind], "wb");
+    if (!file) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    memcpy(hdr.magic, DAC161S997_SCHED_MAGIC, sizeof(hdr.magic));
+    hdr.version = DAC161S997_SCHED_VERSION;
+    hdr.n_chans = (uint32_t)n_chans;
+    /* Channel by channel, times then setpoints padded to 8 bytes */
+    off = sizeof(hdr) + n_chans * sizeof(_cols[0]);
+    for (size_t ch = 0; ch < n_chans; ch++) {
+        _cols[ch].n = n;
+        _cols[ch].ts_off = off;
+        _cols[ch].na_off = off + n * sizeof(uint64_t);
+        off = _cols[ch].na_off + ((n * sizeof(int32_t) + 7) & ~(uint64_t)7);
+    }
+    fwrite(&hdr, sizeof(hdr), 1, file);
+    fwrite(_cols, sizeof(_cols[0]), n_chans, file);
+
+    for (size_t ch = 0; ch < n_chans; ch++) {
+        for (uint64_t i = 0; i < n; i += _CHUNK) {
+            size_t count = (n - i < _CHUNK) ? (size_t)(n - i) : _CHUNK;
+
+            for (size_t k = 0; k < count; k++) {
+                _ts[k] = (i + k) * period + ch * period / n_chans;
+            }
+            fwrite(_ts, sizeof(_ts[0]), count, file);
+        }
+        for (uint64_t i = 0; i < n; i += _CHUNK) {
+            size_t count = (n - i < _CHUNK) ? (size_t)(n - i) : _CHUNK;
+
+            for (size_t k = 0; k < count; k++) {
+                _na[k] = _sample(ch, i + k);
+            }
+            fwrite(_na, sizeof(_na[0]), count, file);
+        }
+        if (n & 1) {
+            fwrite(_na, sizeof(_na[0]), 1, file);
+        }
+    }
+    if (fclose(file)) {
+        perror(argv[optind]);
+        return 1;
+    }
+    printf("channels %zu samples %llu bytes %llu\n", n_chans,
+           (unsigned long long)n, (unsigned long long)off);
+    return 0;
+}
+
+static int32_t _sample(size_t ch, uint64_t i)
+{
+    /* Triangle with a period of 200 to 455 samples depending on the channel */
+    uint64_t half = 100 + (ch * 37) % 128;
+    uint64_t pos = i % (2 * half);
+
+    if (pos > half) {
+        pos = 2 * half - pos;
+    }
+    return 4000000 + (int32_t)(pos * _SPAN_NA / half);
+}
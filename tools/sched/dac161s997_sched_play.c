@@ -0,0 +1,271 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/**
+ ******************************************************************************
+ * @file            dac161s997_sched_play.c
+ * @author          Kevin Weiss
+ * @brief           Plays a schedule file on emulated devices
+ *
+ * Maps the file and feeds the columns to the player a block at a time,
+ * dropping the pages of the blocks already played so memory use stays
+ * constant whatever the size of the file. Samples are dispatched on the host
+ * monotonic clock, sleeping until shortly before they are due and spinning
+ * for the rest.
+ *
+ * Usage: dac161s997_sched_play [-a] [-l late_ns] [-b block] file
+ *
+ * -a dispatches each sample as soon as it is converted, on a virtual clock,
+ * to measure how fast the schedule could be played. The exit code is 1 if
+ * any sample was late, skipped or failed.
+ ******************************************************************************
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "dac161s997.h"
+#include "dac161s997_sched.h"
+#include "dac161s997_emu.h"
+#include "dac161s997_emu_port.h"
+
+/* Private defines ************************************************************/
+#define _MAX_CHANS          256
+#define _DEFAULT_LATE_NS    100000      /* 100 us */
+#define _DEFAULT_BLOCK      4096
+#define _START_NS           1000000     /* Lead time before the first sample */
+#define _SPIN_NS            100000      /* Spin instead of sleeping below this */
+
+/* Private typedefs ***********************************************************/
+typedef struct {
+    const uint64_t *ts_ns;  /* Columns of the channel in the mapping */
+    const int32_t *n_amps;
+    uint64_t n;             /* Samples of the channel */
+    uint64_t fed;           /* Samples handed to the player */
+    size_t ts_done;         /* Offsets up to which pages were dropped */
+    size_t na_done;
+} _chan_t;
+
+/* Private variables **********************************************************/
+static dac161s997_dev_t _devs[_MAX_CHANS];
+static dac161s997_dev_t *_dev_ptrs[_MAX_CHANS];
+static dac161s997_sched_chan_t _sched_chans[_MAX_CHANS];
+static dac161s997_sched_t _sched;
+static _chan_t _chans[_MAX_CHANS];
+static uint8_t *_map;
+static size_t _page;
+
+/* Private functions **********************************************************/
+static int _open(const char *path, size_t *n_chans, uint64_t *n_samples);
+
+static size_t _refill(size_t n_chans, size_t block);
+
+static void _drop(size_t *done, const void *upto);
+
+static void _wait_until(uint64_t t);
+
+static uint64_t _host_ns(void);
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+int main(int argc, char **argv)
+{
+    int asap = 0;
+    uint64_t late_ns = _DEFAULT_LATE_NS;
+    size_t block = _DEFAULT_BLOCK;
+    size_t n_chans;
+    uint64_t n_samples;
+    uint64_t next, t0, t1;
+    const dac161s997_sched_stats_t *stats = &_sched.stats;
+    struct rusage usage;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "al:b:")) != -1) {
+        switch (opt) {
+        case 'a':
+            asap = 1;
+            break;
+        case 'l':
+            late_ns = strtoull(optarg, NULL, 0);
+            break;
+        case 'b':
+            block = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if (optind != argc - 1 || block == 0) {
+        fprintf(stderr, "usage: %s [-a] [-l late_ns] [-b block] file\n",
+                argv[0]);
+        return 2;
+    }
+    if (_open(argv[optind], &n_chans, &n_samples)) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < n_chans; i++) {
+        dac161s997_emu_port_init(&_devs[i], (uint32_t)i + 1);
+        _dev_ptrs[i] = &_devs[i];
+        dac161s997_init(&_devs[i]);
+    }
+    dac161s997_sched_init(&_sched, _sched_chans, _dev_ptrs, n_chans, late_ns);
+
+    t0 = _host_ns();
+    _sched.start_ns = asap ? 0 : t0 + _START_NS;
+    _refill(n_chans, block);
+    for (;;) {
+        /* Feed the channels done with their block and convert them too */
+        while (dac161s997_sched_convert(&_sched) && _refill(n_chans, block)) {
+        }
+        next = dac161s997_sched_next_due(&_sched);
+        if (next == UINT64_MAX) {
+            break;
+        }
+        if (!asap) {
+            _wait_until(next);
+            next = _host_ns();
+        }
+        dac161s997_sched_dispatch(&_sched, next);
+    }
+    t1 = _host_ns();
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("samples %llu sent %llu skipped %llu late %llu invalid %llu"
+           " failed %llu\n", (unsigned long long)n_samples,
+           (unsigned long long)stats->sent, (unsigned long long)stats->skipped,
+           (unsigned long long)stats->late, (unsigned long long)stats->invalid,
+           (unsigned long long)stats->failed);
+    printf("delay mean %.1f us max %.1f us, %.3f s, %.0f samples/s,"
+           " max rss %ld KiB\n",
+           stats->sent ? stats->late_sum_ns / 1e3 / (double)stats->sent : 0.0,
+           stats->late_max_ns / 1e3, (t1 - t0) / 1e9,
+           n_samples * 1e9 / (double)(t1 - t0 + 1), usage.ru_maxrss);
+    return (stats->late || stats->skipped || stats->failed) ? 1 : 0;
+}
+
+static int _open(const char *path, size_t *n_chans, uint64_t *n_samples)
+{
+    const dac161s997_sched_hdr_t *hdr;
+    const dac161s997_sched_col_t *cols;
+    struct stat st;
+    size_t size;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st)) {
+        perror(path);
+        return -1;
+    }
+    size = (size_t)st.st_size;
+    _map = (size < sizeof(*hdr)) ? MAP_FAILED :
+           mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (_map == MAP_FAILED) {
+        fprintf(stderr, "%s: cannot map\n", path);
+        return -1;
+    }
+    madvise(_map, size, MADV_SEQUENTIAL);
+    _page = (size_t)sysconf(_SC_PAGESIZE);
+
+    hdr = (const dac161s997_sched_hdr_t *)_map;
+    cols = (const dac161s997_sched_col_t *)&hdr[1];
+    if (memcmp(hdr->magic, DAC161S997_SCHED_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != DAC161S997_SCHED_VERSION || hdr->n_chans == 0 ||
+        hdr->n_chans > _MAX_CHANS ||
+        size < sizeof(*hdr) + hdr->n_chans * sizeof(*cols)) {
+        fprintf(stderr, "%s: not a schedule file\n", path);
+        return -1;
+    }
+    *n_chans = hdr->n_chans;
+    *n_samples = 0;
+    for (size_t i = 0; i < *n_chans; i++) {
+        const dac161s997_sched_col_t *col = &cols[i];
+
+        if (col->n > size / sizeof(uint64_t) || col->ts_off % 8 ||
+            col->na_off % 4 || col->ts_off > size - col->n * 8 ||
+            col->na_off > size - col->n * 4) {
+            fprintf(stderr, "%s: channel %zu out of the file\n", path, i);
+            return -1;
+        }
+        _chans[i].ts_ns = (const uint64_t *)&_map[col->ts_off];
+        _chans[i].n_amps = (const int32_t *)&_map[col->na_off];
+        _chans[i].n = col->n;
+        _chans[i].ts_done = col->ts_off & ~(_page - 1);
+        _chans[i].na_done = col->na_off & ~(_page - 1);
+        *n_samples += col->n;
+    }
+    return 0;
+}
+
+static size_t _refill(size_t n_chans, size_t block)
+{
+    size_t fed = 0;
+
+    for (size_t i = 0; i < n_chans; i++) {
+        _chan_t *chan = &_chans[i];
+        size_t count;
+
+        if (chan->fed >= chan->n || !dac161s997_sched_hungry(&_sched, i)) {
+            continue;
+        }
+        /* The previous block is converted, its pages are not needed again */
+        _drop(&chan->ts_done, &chan->ts_ns[chan->fed]);
+        _drop(&chan->na_done, &chan->n_amps[chan->fed]);
+
+        count = (chan->n - chan->fed < block) ? (size_t)(chan->n - chan->fed) :
+                                                block;
+        dac161s997_sched_feed(&_sched, i, &chan->ts_ns[chan->fed],
+                              &chan->n_amps[chan->fed], count);
+        chan->fed += count;
+        fed++;
+    }
+    return fed;
+}
+
+static void _drop(size_t *done, const void *upto)
+{
+    size_t end = (size_t)((const uint8_t *)upto - _map) & ~(_page - 1);
+
+    if (end > *done) {
+        madvise(&_map[*done], end - *done, MADV_DONTNEED);
+        *done = end;
+    }
+}
+
+static void _wait_until(uint64_t t)
+{
+    struct timespec ts;
+
+    if (t > _host_ns() + _SPIN_NS) {
+        ts.tv_sec = (time_t)((t - _SPIN_NS) / 1000000000ULL);
+        ts.tv_nsec = (long)((t - _SPIN_NS) % 1000000000ULL);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+    while (_host_ns() < t) {
+    }
+}
+
+static uint64_t _host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
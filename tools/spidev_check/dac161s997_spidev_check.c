@@ -0,0 +1,173 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/**
+ ******************************************************************************
+ * @file            dac161s997_spidev_check.c
+ * @author          Kevin Weiss
+ * @brief           Runs the spidev backend against an emulated chip
+ *
+ * The ioctl of the backend is replaced by a stand-in spidev that clocks the
+ * transfers through the emulator, honouring cs_change the way the kernel
+ * does. Any chip select mistake shows up as a frame error of the chip.
+ * Prints the frames and syscalls used and exits with 1 on any mismatch.
+ ******************************************************************************
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#include "dac161s997.h"
+#include "dac161s997_port.h"
+#include "dac161s997_emu.h"
+#include "dac161s997_spidev.h"
+
+/* Private defines ************************************************************/
+#define _MAX_CS_LOW_BYTES   64
+#define _CHECK(cond)        _check((cond), #cond, __LINE__)
+
+/* Private typedefs ***********************************************************/
+struct dac161s997_dev_t {
+    dac161s997_spidev_t spi;
+    dac161s997_ctx_t ctx;
+};
+
+/* Private variables **********************************************************/
+static dac161s997_emu_t _emu;
+static uint8_t _tx[_MAX_CS_LOW_BYTES];
+static uint8_t _rx[_MAX_CS_LOW_BYTES];
+static size_t _cs_low_bytes;
+static unsigned long _syscalls;
+static int _failed;
+
+/* Private functions **********************************************************/
+static void _check(int cond, const char *what, int line)
+{
+    if (!cond) {
+        fprintf(stderr, "line %d: %s failed\n", line, what);
+        _failed = 1;
+    }
+}
+
+static void _cs_release(void)
+{
+    if (_cs_low_bytes) {
+        dac161s997_emu_xfer(&_emu, _tx, _rx, _cs_low_bytes);
+    }
+}
+
+static int _fake_ioctl(int fd, unsigned long request, void *arg)
+{
+    struct spi_ioc_transfer *tr = arg;
+    size_t n;
+
+    (void)fd;
+    _syscalls++;
+    if (_IOC_TYPE(request) != SPI_IOC_MAGIC || _IOC_NR(request) != 0 ||
+        _IOC_DIR(request) != _IOC_WRITE) {
+        /* Mode, word size and speed setup */
+        return 0;
+    }
+
+    n = _IOC_SIZE(request) / sizeof(*tr);
+    for (size_t i = 0, span = 0; i < n; i++) {
+        if (_cs_low_bytes + tr[i].len > sizeof(_tx)) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        memcpy(&_tx[_cs_low_bytes], (void *)(uintptr_t)tr[i].tx_buf,
+               tr[i].len);
+        _cs_low_bytes += tr[i].len;
+        if (i + 1 == n && tr[i].cs_change) {
+            /* Chip select low across messages, not needed by the driver */
+            errno = EINVAL;
+            return -1;
+        }
+        /* cs_change releases between transfers, keeps it low after the last */
+        if ((i + 1 < n) == !!tr[i].cs_change) {
+            size_t offset = 0;
+
+            _cs_release();
+            for (; span <= i; span++) {
+                memcpy((void *)(uintptr_t)tr[span].rx_buf, &_rx[offset],
+                       tr[span].len);
+                offset += tr[span].len;
+            }
+            _cs_low_bytes = 0;
+        }
+    }
+    return (int)_IOC_SIZE(request);
+}
+
+/******************************************************************************/
+/* Port                                                                       */
+/******************************************************************************/
+int dac161s997_spi_xfer(dac161s997_dev_t *dev, uint8_t *tx_buf,
+                        uint8_t *rx_buf, size_t size)
+{
+    return dac161s997_spidev_xfer(&dev->spi, tx_buf, rx_buf, size);
+}
+
+int dac161s997_spi_xfer_vec(dac161s997_dev_t *dev,
+                            const dac161s997_spi_seg_t *segs, size_t n)
+{
+    return dac161s997_spidev_xfer_vec(&dev->spi, segs, n);
+}
+
+dac161s997_ctx_t *dac161s997_get_ctx(dac161s997_dev_t *dev)
+{
+    return &dev->ctx;
+}
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+int main(void)
+{
+    static dac161s997_dev_t dev;
+    static dac161s997_op_t ops[20];
+    uint32_t status;
+    unsigned long setup_syscalls;
+
+    dac161s997_emu_init(&_emu, 1);
+    dev.spi.fd = 3;
+    dev.spi.speed_hz = 1000000;
+    dev.spi.ioctl = _fake_ioctl;
+    _CHECK(dac161s997_spidev_setup(&dev.spi, SPI_MODE_0) == 0);
+    setup_syscalls = _syscalls;
+
+    _CHECK(dac161s997_init(&dev) == 0);
+    for (int32_t na = 4000000; na <= 20000000; na += 1000000) {
+        _CHECK(dac161s997_set_output(&dev, na) == 0);
+        _CHECK(dac161s997_emu_output_na(&_emu) - na < 200 &&
+               na - dac161s997_emu_output_na(&_emu) < 200);
+    }
+    _CHECK(dac161s997_set_alarm(&dev, DAC161S997_ALARM_HIGH_FAIL) == 0);
+    _CHECK(dac161s997_get_status(&dev, &status) == 0);
+    _CHECK(status == DAC161S997_HI_ALARM_ERR);
+
+    /* Longer than a batch chunk and a spidev message */
+    for (size_t i = 0; i < 20; i++) {
+        dac161s997_op_t op = DAC161S997_OP_READ(DAC161S997_ERR_CONFIG_REG);
+
+        ops[i] = op;
+    }
+    _CHECK(dac161s997_xfer_batch(&dev, ops, 20) == 0);
+    _CHECK(ops[19].data == _emu.regs[DAC161S997_ERR_CONFIG_REG]);
+
+    _CHECK(_emu.frame_errors == 0);
+    printf("frames %llu syscalls %lu\n", (unsigned long long)_emu.frames,
+           _syscalls - setup_syscalls);
+    return _failed;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/**
+ ******************************************************************************
+ * @file            dac161s997_trace_record.c
+ * @author          Kevin Weiss
+ * @brief           Records a trace of the driver running on the emulator
+ *
+ * Drives a fleet of emulated devices with a random mix of setpoints, alarms
+ * and status polls and writes the trace of all of them to a file, flushing
+ * the ring between calls as a logging task would.
+ *
+ * Usage: dac161s997_trace_record [-n calls] [-d devices] [-s seed]
+ *                                [-f flip_rate] [-r retries] [-l] file
+ *
+ * -f flips a MISO bit every flip_rate frames on average, -r resends calls
+ * with a bad echo and -l verifies writes lazily.
+ ******************************************************************************
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "dac161s997.h"
+#include "dac161s997_trace.h"
+#include "dac161s997_emu.h"
+#include "dac161s997_emu_port.h"
+
+/* Private defines ************************************************************/
+#define _MAX_DEVS           256
+#define _DEFAULT_CALLS      100000
+#define _DEFAULT_DEVS       16
+#define _RING_RECS          4096
+#define _CALL_GAP_NS        20000   /* Idle time between two calls */
+
+/* Private variables **********************************************************/
+static dac161s997_dev_t _devs[_MAX_DEVS];
+static dac161s997_trace_rec_t _ring[_RING_RECS];
+static dac161s997_trace_rec_t _out[_RING_RECS];
+static dac161s997_trace_t _trace;
+
+/* Private functions **********************************************************/
+static int _call(dac161s997_dev_t *dev, uint32_t r);
+
+static size_t _flush(FILE *file);
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+int main(int argc, char **argv)
+{
+    size_t calls = _DEFAULT_CALLS;
+    size_t n_devs = _DEFAULT_DEVS;
+    uint32_t seed = 1;
+    uint32_t flip_rate = 0;
+    uint8_t retries = 0;
+    DAC161S997_VERIFY_t policy = DAC161S997_VERIFY_ALWAYS;
+    size_t recs = 0;
+    size_t failed = 0;
+    dac161s997_trace_hdr_t hdr;
+    FILE *file;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:d:s:f:r:l")) != -1) {
+        switch (opt) {
+        case 'n':
+            calls = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            n_devs = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            flip_rate = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            retries = (uint8_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            policy = DAC161S997_VERIFY_LAZY;
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if (optind != argc - 1 || n_devs == 0 || n_devs > _MAX_DEVS) {
+        fprintf(stderr, "usage: %s [-n calls] [-d devices] [-s seed]"
+                " [-f flip_rate] [-r retries] [-l] file\n", argv[0]);
+        return 2;
+    }
+    file = fopen(argv[optind], "wb");
+    if (!file) {
+        perror(argv[optind]);
+        return 1;
+    }
+    dac161s997_trace_hdr(&hdr);
+    fwrite(&hdr, sizeof(hdr), 1, file);
+    dac161s997_trace_init(&_trace, _ring, _RING_RECS);
+
+    srand(seed);
+    for (size_t i = 0; i < n_devs; i++) {
+        dac161s997_emu_port_init(&_devs[i], seed + (uint32_t)i);
+        dac161s997_trace_attach(&_devs[i], &_trace, (uint16_t)i);
+        dac161s997_set_verify(&_devs[i], policy, 0, retries);
+        failed += (dac161s997_init(&_devs[i]) != 0);
+        if (flip_rate) {
+            _devs[i].emu.faults |= DAC161S997_EMU_FAULT_BIT_FLIP;
+            _devs[i].emu.bit_flip_rate = flip_rate;
+        }
+        recs += _flush(file);
+    }
+    for (size_t i = 0; i < calls; i++) {
+        uint32_t r = (uint32_t)rand();
+
+        failed += (_call(&_devs[r % n_devs], r / _MAX_DEVS) != 0);
+        dac161s997_emu_port_advance(_CALL_GAP_NS);
+        recs += _flush(file);
+    }
+    fclose(file);
+
+    printf("calls %zu failed %zu records %zu dropped %u\n", calls + n_devs,
+           failed, recs, _trace.dropped);
+    return 0;
+}
+
+static int _call(dac161s997_dev_t *dev, uint32_t r)
+{
+    uint32_t status;
+
+    switch (r % 8) {
+    case 0:
+        return dac161s997_set_alarm(dev, (r & 8) ? DAC161S997_ALARM_HIGH_FAIL :
+                                                   DAC161S997_ALARM_LOW_FAIL);
+    case 1:
+    case 2:
+        return dac161s997_get_status_fast(dev, &status);
+    case 3:
+        return dac161s997_get_status(dev, &status);
+    default:
+        /* Few distinct setpoints so some writes are skipped */
+        return dac161s997_set_output(dev, 4000000 + (int32_t)(r / 8 % 5) *
+                                          4000000);
+    }
+}
+
+static size_t _flush(FILE *file)
+{
+    size_t total = 0;
+    size_t n;
+
+    while ((n = dac161s997_trace_read(&_trace, _out, _RING_RECS)) > 0) {
+        fwrite(_out, sizeof(_out[0]), n, file);
+        total += n;
+    }
+    return total;
+}
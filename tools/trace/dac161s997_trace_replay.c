@@ -0,0 +1,366 @@
+/*
+ * Copyright 2020 Kevin Weiss for Accelovant
+ *
+ * This file is subject to the terms and conditions of the MIT License. See the
+ * file LICENSE in the top level directory for more details.
+ * SPDX-License-Identifier:    MIT
+ */
+
+/**
+ ******************************************************************************
+ * @file            dac161s997_trace_replay.c
+ * @author          Kevin Weiss
+ * @brief           Replays a trace through the driver
+ *
+ * Memory maps a trace file and makes the same driver calls again, in order,
+ * against devices scripted by the trace: every frame the driver sends is
+ * compared with the one recorded and answered with the recorded MISO bytes.
+ * As the driver sees the same answers it must send the same frames, any
+ * difference is a divergence. Calls run back to back without any SPI.
+ *
+ * Prints one tab separated line per kind of call with the number of calls,
+ * frames per call, recorded time per call (from the first to the last frame
+ * of the call), replay time per call and divergent calls, then a summary.
+ * The exit code is 1 if any call diverged.
+ *
+ * Usage: dac161s997_trace_replay [-r retries] [-l] [-q] file
+ *
+ * -r and -l must match the verification the trace was recorded with, -q
+ * does not print the divergent frames.
+ ******************************************************************************
+ */
+
+/* Includes *******************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dac161s997.h"
+#include "dac161s997_port.h"
+#include "dac161s997_trace.h"
+#include "internal/dac161s997_regs.h"
+
+/* Private defines ************************************************************/
+#define _MAX_OPS            256
+#define _MAX_REPORTED       10
+#define _KINDS              3
+#define _CLASSES            257     /* First byte sent, or none */
+#define _NO_OP              256
+
+/* Private typedefs ***********************************************************/
+typedef struct {
+    uint64_t calls;
+    uint64_t frames;
+    uint64_t recorded_ns;
+    uint64_t replay_ns;
+    uint64_t diverged;
+} _class_t;
+
+/* Typedefs *******************************************************************/
+struct dac161s997_dev_t {
+    dac161s997_ctx_t ctx;   /**< Driver context */
+    uint16_t id;            /**< Id in the trace */
+    size_t pos;             /**< Next record of the device */
+    const dac161s997_trace_rec_t *last; /**< Last frame of the call */
+    size_t frames;          /**< Frames sent in the call */
+    size_t diverged;        /**< Frames of the call that diverged */
+};
+
+/* Private variables **********************************************************/
+static const dac161s997_trace_rec_t *_recs;
+static size_t _n_recs;
+static uint32_t *_next_same;    /* Next record of the same device */
+static int _quiet;
+static size_t _reported;
+static _class_t _classes[_KINDS][_CLASSES];
+
+/* Private functions **********************************************************/
+static const dac161s997_trace_rec_t *_next_frame(dac161s997_dev_t *dev);
+
+static void _report(dac161s997_dev_t *dev, const char *what,
+                    const uint8_t *sent, const uint8_t *recorded);
+
+static size_t _replay(dac161s997_dev_t *dev, size_t call);
+
+static uint64_t _host_ns(void);
+
+static const char *_class_name(unsigned kind, unsigned cls, char *buf,
+                               size_t size);
+
+/******************************************************************************/
+/* Functions                                                                  */
+/******************************************************************************/
+int dac161s997_spi_xfer(dac161s997_dev_t *dev, uint8_t *tx_buf,
+                        uint8_t *rx_buf, size_t size)
+{
+    const dac161s997_trace_rec_t *rec = _next_frame(dev);
+
+    dev->frames++;
+    if (!rec) {
+        _report(dev, "extra frame", tx_buf, NULL);
+        memset(rx_buf, 0xFF, size);
+        return 0;
+    }
+    if (size != DAC161S997_FRAME_SIZE ||
+        memcmp(tx_buf, rec->tx, DAC161S997_FRAME_SIZE)) {
+        _report(dev, "frame differs", tx_buf, rec->tx);
+    }
+    memcpy(rx_buf, rec->rx, DAC161S997_FRAME_SIZE);
+    return (rec->dev & DAC161S997_TRACE_ERR) ? -EIO : 0;
+}
+
+dac161s997_ctx_t *dac161s997_get_ctx(dac161s997_dev_t *dev)
+{
+    return &dev->ctx;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t retries = 0;
+    DAC161S997_VERIFY_t policy = DAC161S997_VERIFY_ALWAYS;
+    const dac161s997_trace_hdr_t *hdr;
+    dac161s997_dev_t *devs;
+    size_t n_devs = 0;
+    size_t calls = 0;
+    size_t frames = 0;
+    size_t diverged = 0;
+    uint64_t t0, t1;
+    struct stat st;
+    void *map;
+    int fd;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:lq")) != -1) {
+        switch (opt) {
+        case 'r':
+            retries = (uint8_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            policy = DAC161S997_VERIFY_LAZY;
+            break;
+        case 'q':
+            _quiet = 1;
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-r retries] [-l] [-q] file\n", argv[0]);
+        return 2;
+    }
+    fd = open(argv[optind], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) || (size_t)st.st_size < sizeof(*hdr)) {
+        perror(argv[optind]);
+        return 1;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    hdr = map;
+    if (memcmp(hdr->magic, DAC161S997_TRACE_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != DAC161S997_TRACE_VERSION ||
+        hdr->rec_size != sizeof(dac161s997_trace_rec_t)) {
+        fprintf(stderr, "%s: not a version %d trace\n", argv[optind],
+                DAC161S997_TRACE_VERSION);
+        return 1;
+    }
+    _recs = (const dac161s997_trace_rec_t *)(hdr + 1);
+    _n_recs = ((size_t)st.st_size - sizeof(*hdr)) / sizeof(*_recs);
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    /* Link the records of each device, walking back from the end */
+    _next_same = malloc((_n_recs ? _n_recs : 1) * sizeof(*_next_same));
+    devs = calloc(DAC161S997_TRACE_DEV_MASK + 1, sizeof(*devs));
+    for (size_t i = 0; i <= DAC161S997_TRACE_DEV_MASK; i++) {
+        devs[i].pos = _n_recs;
+    }
+    for (size_t i = _n_recs; i-- > 0;) {
+        size_t id = _recs[i].dev & DAC161S997_TRACE_DEV_MASK;
+
+        _next_same[i] = (uint32_t)devs[id].pos;
+        devs[id].pos = i;
+        if (id >= n_devs) {
+            n_devs = id + 1;
+        }
+    }
+    for (size_t i = 0; i < n_devs; i++) {
+        devs[i].id = (uint16_t)i;
+        dac161s997_set_verify(&devs[i], policy, 0, retries);
+    }
+
+    t0 = _host_ns();
+    for (size_t i = 0; i < _n_recs; i++) {
+        if (_recs[i].dev & DAC161S997_TRACE_CALL) {
+            dac161s997_dev_t *dev = &devs[_recs[i].dev &
+                                          DAC161S997_TRACE_DEV_MASK];
+
+            frames += _replay(dev, i);
+            diverged += (dev->diverged != 0);
+            calls++;
+        }
+    }
+    t1 = _host_ns();
+
+    printf("# call\tcalls\tframes/call\trecorded_ns/call\treplay_ns/call"
+           "\tdiverged\n");
+    for (unsigned kind = 0; kind < _KINDS; kind++) {
+        for (unsigned cls = 0; cls < _CLASSES; cls++) {
+            const _class_t *c = &_classes[kind][cls];
+            char name[32];
+
+            if (!c->calls) {
+                continue;
+            }
+            printf("%s\t%llu\t%.3f\t%.1f\t%.1f\t%llu\n",
+                   _class_name(kind, cls, name, sizeof(name)),
+                   (unsigned long long)c->calls,
+                   (double)c->frames / c->calls,
+                   (double)c->recorded_ns / c->calls,
+                   (double)c->replay_ns / c->calls,
+                   (unsigned long long)c->diverged);
+        }
+    }
+    printf("# %zu records, %zu devices, %zu calls, %zu frames, %zu diverged,"
+           " %.1f ms, %.1f Mframes/s\n", _n_recs, n_devs, calls, frames,
+           diverged, (t1 - t0) / 1e6, frames * 1e3 / (double)(t1 - t0 + 1));
+
+    munmap(map, (size_t)st.st_size);
+    close(fd);
+    free(_next_same);
+    free(devs);
+    return diverged != 0;
+}
+
+static const dac161s997_trace_rec_t *_next_frame(dac161s997_dev_t *dev)
+{
+    const dac161s997_trace_rec_t *rec;
+
+    /* The call ends with the next call of the same device */
+    if (dev->pos >= _n_recs || (_recs[dev->pos].dev & DAC161S997_TRACE_CALL)) {
+        return NULL;
+    }
+    rec = &_recs[dev->pos];
+    dev->pos = _next_same[dev->pos];
+    dev->last = rec;
+    return rec;
+}
+
+static void _report(dac161s997_dev_t *dev, const char *what,
+                    const uint8_t *sent, const uint8_t *recorded)
+{
+    dev->diverged++;
+    if (_quiet || _reported++ >= _MAX_REPORTED) {
+        return;
+    }
+    printf("# record %zu device %u: %s, sent %02X %02X %02X", dev->pos,
+           dev->id, what, sent[0], sent[1], sent[2]);
+    if (recorded) {
+        printf(" recorded %02X %02X %02X", recorded[0], recorded[1],
+               recorded[2]);
+    }
+    printf("\n");
+}
+
+static size_t _replay(dac161s997_dev_t *dev, size_t call)
+{
+    const dac161s997_trace_rec_t *rec = &_recs[call];
+    unsigned kind = rec->tx[0];
+    size_t n = ((size_t)rec->tx[1] << 8) | rec->tx[2];
+    unsigned cls = _NO_OP;
+    dac161s997_op_t ops[_MAX_OPS];
+    uint8_t rx_buf[DAC161S997_FRAME_SIZE];
+    uint16_t data;
+    uint64_t t0;
+    _class_t *c;
+
+    /* The ops of the call are the first frames it sent */
+    dev->pos = _next_same[call];
+    for (size_t i = 0; i < n && i < _MAX_OPS; i++) {
+        const dac161s997_trace_rec_t *frame = _next_frame(dev);
+
+        if (!frame) {
+            n = i;
+            break;
+        }
+        ops[i].addr = frame->tx[0];
+        ops[i].data = (uint16_t)((frame->tx[1] << 8) | frame->tx[2]);
+        if (i == 0) {
+            cls = frame->tx[0];
+        }
+    }
+    dev->pos = _next_same[call];
+    dev->last = rec;
+    dev->frames = 0;
+    dev->diverged = 0;
+
+    t0 = _host_ns();
+    switch (kind) {
+    case DAC161S997_TRACE_CALL_BATCH:
+        dac161s997_xfer_batch(dev, ops, n);
+        break;
+    case DAC161S997_TRACE_CALL_READ:
+        if (n) {
+            dac161s997_read_pipelined(dev, ops[0].addr & ~DAC161S997_REG_READ,
+                                      &data);
+        }
+        break;
+    case DAC161S997_TRACE_CALL_FRAME:
+        if (n) {
+            uint8_t tx_buf[DAC161S997_FRAME_SIZE];
+
+            dac161s997_encode_frame(tx_buf, ops[0].addr, ops[0].data);
+            dac161s997_xfer_frame(dev, tx_buf, rx_buf);
+        }
+        break;
+    default:
+        _report(dev, "unknown call", rec->tx, NULL);
+        return 0;
+    }
+    c = &_classes[kind][cls];
+    c->replay_ns += _host_ns() - t0;
+
+    /* Whatever the driver did not ask for is missing from the replay */
+    while ((rec = _next_frame(dev)) != NULL) {
+        _report(dev, "missing frame", rec->tx, NULL);
+    }
+    c->calls++;
+    c->frames += dev->frames;
+    c->recorded_ns += dev->last->ts_ns - _recs[call].ts_ns;
+    c->diverged += (dev->diverged != 0);
+    return dev->frames;
+}
+
+static uint64_t _host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static const char *_class_name(unsigned kind, unsigned cls, char *buf,
+                               size_t size)
+{
+    static const char *const kinds[_KINDS] = { "batch", "read", "frame" };
+
+    if (cls == _NO_OP) {
+        snprintf(buf, size, "%s_nop", kinds[kind]);
+    }
+    else {
+        snprintf(buf, size, "%s_%s_%02X", kinds[kind],
+                 (cls & DAC161S997_REG_READ) ? "read" : "write",
+                 cls & ~DAC161S997_REG_READ);
+    }
+    return buf;
+}